@@ -21,7 +21,11 @@ const int kBallSpeed = kBarSpeed;
 
 array<bitset<kNumBlocksX>, kNumBlocksY> blocks;
 
-void DrawBlocks(uint64_t layer_id) {
+// 1 フレーム分の描画命令．まとめて 1 回のシステムコールで描く
+array<DrawOp, kNumBlocksX * kNumBlocksY + 4> ops;
+size_t num_ops = 0;
+
+void DrawBlocks() {
   for (int by = 0; by < kNumBlocksY; ++by) {
     const int y = 24 + kGapHeight + by * kBlockHeight;
     const uint32_t color = 0xff << (by % 3) * 8;
@@ -30,25 +34,22 @@ void DrawBlocks(uint64_t layer_id) {
       if (blocks[by][bx]) {
         const int x = 4 + kGapWidth + bx * kBlockWidth;
         const uint32_t c = color | (0xff << ((bx + by) % 3) * 8);
-        SyscallWinFillRectangle(layer_id, x, y, kBlockWidth, kBlockHeight, c);
+        ops[num_ops++] = DrawOpFillRect(x, y, kBlockWidth, kBlockHeight, c);
       }
     }
   }
 }
 
-void DrawBar(uint64_t layer_id, int bar_x) {
-  SyscallWinFillRectangle(layer_id,
-                          4 + bar_x, 24 + kBarY,
-                          kBarWidth, kBarHeight, 0xffffff);
+void DrawBar(int bar_x) {
+  ops[num_ops++] = DrawOpFillRect(4 + bar_x, 24 + kBarY,
+                                  kBarWidth, kBarHeight, 0xffffff);
 }
 
-void DrawBall(uint64_t layer_id, int x, int y) {
-  SyscallWinFillRectangle(layer_id,
-                          4 + x - kBallRadius, 24 + y - kBallRadius,
-                          2 * kBallRadius, 2 * kBallRadius, 0x007f00);
-  SyscallWinFillRectangle(layer_id,
-                          4 + x - kBallRadius/2, 24 + y - kBallRadius/2,
-                          kBallRadius, kBallRadius, 0x00ff00);
+void DrawBall(int x, int y) {
+  ops[num_ops++] = DrawOpFillRect(4 + x - kBallRadius, 24 + y - kBallRadius,
+                                  2 * kBallRadius, 2 * kBallRadius, 0x007f00);
+  ops[num_ops++] = DrawOpFillRect(4 + x - kBallRadius/2, 24 + y - kBallRadius/2,
+                                  kBallRadius, kBallRadius, 0x00ff00);
 }
 
 template <class T>
@@ -83,15 +84,15 @@ int main(int argc, char** argv) {
 
   for (;;) {
     // 画面を一旦クリアし，各種オブジェクトを描画
-    SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                            4, 24, kCanvasWidth, kCanvasHeight, 0);
+    num_ops = 0;
+    ops[num_ops++] = DrawOpFillRect(4, 24, kCanvasWidth, kCanvasHeight, 0);
 
-    DrawBlocks(layer_id | LAYER_NO_REDRAW);
-    DrawBar(layer_id | LAYER_NO_REDRAW, bar_x);
+    DrawBlocks();
+    DrawBar(bar_x);
     if (ball_y >= 0) {
-      DrawBall(layer_id | LAYER_NO_REDRAW, ball_x, ball_y);
+      DrawBall(ball_x, ball_y);
     }
-    SyscallWinRedraw(layer_id);
+    SyscallWinDrawBatch(layer_id, ops.data(), num_ops);
 
     static unsigned long prev_timeout = 0;
     if (prev_timeout == 0) {
@@ -0,0 +1,55 @@
+#include "clock.h"
+
+#include "../kernel/time_page.hpp"
+
+static const volatile struct TimePage* const time_page =
+  (const volatile struct TimePage*)TIME_PAGE_ADDR;
+
+static uint64_t ReadTSC(void) {
+  uint32_t lo, hi;
+  __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+/* seq が偶数かつ前後で一致するまで読み直し，一貫したスナップショットを得る */
+static void ReadTimePage(struct TimePage* snapshot) {
+  uint32_t seq;
+  do {
+    seq = time_page->seq;
+    snapshot->timer_freq = time_page->timer_freq;
+    snapshot->tick = time_page->tick;
+    snapshot->tsc_freq = time_page->tsc_freq;
+    snapshot->tsc_base = time_page->tsc_base;
+    snapshot->tsc_to_ns_mult = time_page->tsc_to_ns_mult;
+    snapshot->realtime_offset_ns = time_page->realtime_offset_ns;
+  } while ((seq & 1) || seq != time_page->seq);
+}
+
+static uint64_t MonotonicNs(const struct TimePage* p) {
+  if (p->tsc_freq == 0) {
+    return p->tick * (1000000000ull / p->timer_freq);
+  }
+  const unsigned __int128 delta = ReadTSC() - p->tsc_base;
+  return (uint64_t)((delta * p->tsc_to_ns_mult) >> 32);
+}
+
+uint64_t ClockGetTick(unsigned int* timer_freq) {
+  struct TimePage p;
+  ReadTimePage(&p);
+  if (timer_freq) {
+    *timer_freq = p.timer_freq;
+  }
+  return p.tick;
+}
+
+uint64_t ClockMonotonicNs(void) {
+  struct TimePage p;
+  ReadTimePage(&p);
+  return MonotonicNs(&p);
+}
+
+int64_t ClockRealtimeNs(void) {
+  struct TimePage p;
+  ReadTimePage(&p);
+  return (int64_t)MonotonicNs(&p) + p.realtime_offset_ns;
+}
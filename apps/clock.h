@@ -0,0 +1,24 @@
+#ifdef __cplusplus
+#include <cstdint>
+
+extern "C" {
+#else
+#include <stdint.h>
+#endif
+
+/*
+ * カーネルが割り当てる時刻ページを読んで時刻を得る．システムコールは発行しない．
+ */
+
+/** @brief 起動時からの tick 数．timer_freq が NULL でなければ tick の周波数を書き込む． */
+uint64_t ClockGetTick(unsigned int* timer_freq);
+
+/** @brief 起動時からの経過時間（ナノ秒）．TSC が使えない環境では tick 単位の精度． */
+uint64_t ClockMonotonicNs(void);
+
+/** @brief UNIX 時刻（1970-01-01 00:00:00 UTC からのナノ秒）． */
+int64_t ClockRealtimeNs(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
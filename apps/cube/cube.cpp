@@ -14,11 +14,14 @@ struct Vector2D {
   T x, y;
 };
 
-void DrawObj(uint64_t layer_id);
-void DrawSurface(uint64_t layer_id, int sur);
-bool Sleep(unsigned long ms);
+void DrawObj();
+void DrawSurface(int sur);
+bool SleepNs(unsigned long ns);
 
 const int kScale = 50, kMargin = 10;
+// 60 fps で描画する．1 フレームの描画に使う CPU 時間を予約する
+const unsigned long kFramePeriodNs = 16'666'667;
+const unsigned long kFrameRuntimeNs = 4'000'000;
 const int kCanvasSize = 3 * kScale + kMargin;
 const array<Vector3D<int>, 8> kCube{{
   { 1,  1,  1}, { 1,  1, -1}, { 1, -1,  1}, { 1, -1, -1},
@@ -35,6 +38,10 @@ array<Vector3D<double>, kCube.size()> vert;
 array<double, kSurface.size()> centerz4;
 array<Vector2D<int>, kCube.size()> scr;
 
+// 1 フレーム分の描画命令．まとめて 1 回のシステムコールで描く
+array<DrawOp, 1 + kSurface.size() * kCanvasSize> ops;
+size_t num_ops = 0;
+
 int main(int argc, char** argv) {
   auto [layer_id, err_openwin]
     = SyscallOpenWindow(kCanvasSize + 8, kCanvasSize + 28, 10, 10, "cube");
@@ -42,13 +49,16 @@ int main(int argc, char** argv) {
     return err_openwin;
   }
 
+  // 帯域が確保できなくても，通常のタスクとして描画を続ける
+  SyscallSetDeadline(kFrameRuntimeNs, kFramePeriodNs, 0);
+
   int thx = 0, thy = 0, thz = 0;
   const double to_rad = 3.14159265358979323 / 0x8000;
   for (;;) {
     // 立方体を X, Y, Z 軸回りに回転
-    thx = (thx + 182) & 0xffff;
-    thy = (thy + 273) & 0xffff;
-    thz = (thz + 364) & 0xffff;
+    thx = (thx + 61) & 0xffff;
+    thy = (thy + 91) & 0xffff;
+    thz = (thz + 121) & 0xffff;
     const double xp = cos(thx * to_rad), xa = sin(thx * to_rad);
     const double yp = cos(thy * to_rad), ya = sin(thy * to_rad);
     const double zp = cos(thz * to_rad), za = sin(thz * to_rad);
@@ -71,11 +81,11 @@ int main(int argc, char** argv) {
     }
 
     // 画面を一旦クリアし，立方体を描画
-    SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                            4, 24, kCanvasSize, kCanvasSize, 0);
-    DrawObj(layer_id | LAYER_NO_REDRAW);
-    SyscallWinRedraw(layer_id);
-    if (Sleep(50)) {
+    num_ops = 0;
+    ops[num_ops++] = DrawOpFillRect(4, 24, kCanvasSize, kCanvasSize, 0);
+    DrawObj();
+    SyscallWinDrawBatch(layer_id, ops.data(), num_ops);
+    if (SleepNs(kFramePeriodNs)) {
       break;
     }
   }
@@ -84,7 +94,7 @@ int main(int argc, char** argv) {
   return 0;
 }
 
-void DrawObj(uint64_t layer_id) {
+void DrawObj() {
   // オブジェクト座標 vert を スクリーン座標 scr に変換（画面奥が Z+）
   for (int i = 0; i < kCube.size(); i++) {
     const double t = 6*kScale / (vert[i].z + 8*kScale);
@@ -108,12 +118,12 @@ void DrawObj(uint64_t layer_id) {
     const auto e0x = v1.x - v0.x, e0y = v1.y - v0.y, // v0 --> v1
                e1x = v2.x - v1.x, e1y = v2.y - v1.y; // v1 --> v2
     if (e0x * e1y <= e0y * e1x) {
-      DrawSurface(layer_id, sur);
+      DrawSurface(sur);
     }
   }
 }
 
-void DrawSurface(uint64_t layer_id, int sur) {
+void DrawSurface(int sur) {
   const auto& surface = kSurface[sur]; // 描画する面
   int ymin = kCanvasSize, ymax = 0; // 画面の描画範囲 [ymin, ymax]
   int y2x_up[kCanvasSize], y2x_down[kCanvasSize]; // Y, X 座標の組
@@ -146,18 +156,21 @@ void DrawSurface(uint64_t layer_id, int sur) {
   for (int y = ymin; y <= ymax; y++) {
     int p0x = min(y2x_up[y], y2x_down[y]);
     int p1x = max(y2x_up[y], y2x_down[y]);
-    SyscallWinFillRectangle(layer_id, 4 + p0x, 24 + y, p1x - p0x + 1, 1, kColor[sur]);
+    if (num_ops < ops.size()) {
+      ops[num_ops++] = DrawOpFillRect(4 + p0x, 24 + y, p1x - p0x + 1, 1, kColor[sur]);
+    }
   }
 }
 
-bool Sleep(unsigned long ms) {
+bool SleepNs(unsigned long ns) {
   static unsigned long prev_timeout = 0;
   if (prev_timeout == 0) {
-    const auto timeout = SyscallCreateTimer(TIMER_ONESHOT_REL, 1, ms);
+    const auto timeout = SyscallCreateTimer(
+        TIMER_ONESHOT_REL | TIMER_UNIT_NS, 1, ns);
     prev_timeout = timeout.value;
   } else {
-    prev_timeout += ms;
-    SyscallCreateTimer(TIMER_ONESHOT_ABS, 1, prev_timeout);
+    prev_timeout += ns;
+    SyscallCreateTimer(TIMER_ONESHOT_ABS | TIMER_UNIT_NS, 1, prev_timeout);
   }
 
   AppEvent events[1];
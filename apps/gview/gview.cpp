@@ -86,15 +86,33 @@ int main(int argc, char** argv) {
   }
   const uint64_t layer_id = window.value;
 
+  // アルファチャネルを持つ画像は背後のウィンドウと合成して表示する
+  const bool has_alpha = bytes_per_pixel == 2 || bytes_per_pixel == 4;
+  if (has_alpha) {
+    SyscallWinSetAlphaBlending(layer_id | LAYER_NO_REDRAW, 1);
+  }
+
+  // ウィンドウの影バッファに直接書き込み，最後に 1 回だけ反映する
+  WindowSurface surface;
+  if (auto [ addr, err ] = SyscallWinMapSurface(layer_id, &surface); err) {
+    fprintf(stderr, "%s\n", strerror(err));
+    return 1;
+  }
   for (int y = 0; y < height; ++y) {
+    uint32_t* row = surface.pixels + surface.stride * (24 + y) + 4;
     for (int x = 0; x < width; ++x) {
-      uint32_t c = get_color(&image_data[bytes_per_pixel * (y * width + x)]);
-      SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                              4 + x, 24 + y, 1, 1, c);
+      unsigned char* p = &image_data[bytes_per_pixel * (y * width + x)];
+      uint32_t c = get_color(p);
+      if (has_alpha) {
+        const uint32_t a = p[bytes_per_pixel - 1];
+        row[x] = SurfacePixelARGB(&surface, a << 24 | c);
+      } else {
+        row[x] = SurfacePixel(&surface, c);
+      }
     }
   }
 
-  SyscallWinRedraw(layer_id);
+  SyscallWinCommit(layer_id, 4, 24, width, height);
   WaitEvent();
 
   SyscallCloseWindow(layer_id);
@@ -27,12 +27,15 @@ int main(int argc, char** argv) {
     return err_openwin;
   }
 
+  DrawOp ops[2 * (90 / 5 + 1)];
+  size_t num_ops = 0;
   const int x0 = 4, y0 = 24, x1 = 4 + kRadius + 10, y1 = 24 + kRadius;
   for (int deg = 0; deg <= 90; deg += 5) {
     const int x = kRadius * cos(M_PI * deg / 180.0);
     const int y = kRadius * sin(M_PI * deg / 180.0);
-    SyscallWinDrawLine(layer_id, x0, y0, x0 + x, y0 + y, Color(deg));
-    SyscallWinDrawLine(layer_id, x1, y1, x1 + x, y1 - y, Color(deg + 90));
+    ops[num_ops++] = DrawOpLine(x0, y0, x0 + x, y0 + y, Color(deg));
+    ops[num_ops++] = DrawOpLine(x1, y1, x1 + x, y1 - y, Color(deg + 90));
   }
+  SyscallWinDrawBatch(layer_id, ops, num_ops);
   return 0;
 }
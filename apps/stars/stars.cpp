@@ -1,4 +1,5 @@
 #include <random>
+#include "../clock.h"
 #include "../syscall.h"
 
 static constexpr int kWidth = 100, kHeight = 100;
@@ -32,7 +33,7 @@ int main(int argc, char** argv) {
     num_stars = atoi(argv[1]);
   }
 
-  auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+  const uint64_t ns_start = ClockMonotonicNs();
 
   std::default_random_engine rand_engine;
   std::uniform_int_distribution x_dist(0, kWidth - 2), y_dist(0, kHeight - 2);
@@ -44,10 +45,9 @@ int main(int argc, char** argv) {
   }
   SyscallWinRedraw(layer_id);
 
-  auto tick_end = SyscallGetCurrentTick();
-  printf("%d stars in %lu ms.\n",
-         num_stars,
-         (tick_end.value - tick_start) * 1000 / timer_freq);
+  const uint64_t us_elapsed = (ClockMonotonicNs() - ns_start) / 1000;
+  printf("%d stars in %lu.%03lu ms.\n",
+         num_stars, us_elapsed / 1000, us_elapsed % 1000);
 
   WaitEvent();
   SyscallCloseWindow(layer_id);
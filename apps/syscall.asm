@@ -27,3 +27,10 @@ define_syscall ReadFile,         0x8000000d
 define_syscall DemandPages,      0x8000000e
 define_syscall MapFile,          0x8000000f
 define_syscall IsTerminal,       0x80000010
+define_syscall GetCurrentTimeNs, 0x80000011
+define_syscall SetDeadline,      0x80000012
+define_syscall GetTaskStats,     0x80000013
+define_syscall WinDrawBatch,     0x80000014
+define_syscall WinMapSurface,    0x80000015
+define_syscall WinCommit,        0x80000016
+define_syscall WinSetAlphaBlending, 0x80000017
@@ -10,6 +10,8 @@ extern "C" {
 
 #include "../kernel/logger.hpp"
 #include "../kernel/app_event.hpp"
+#include "../kernel/task_stats.hpp"
+#include "../kernel/app_draw.hpp"
 
 struct SyscallResult {
   uint64_t value;
@@ -36,14 +38,28 @@ struct SyscallResult SyscallReadEvent(struct AppEvent* events, size_t len);
 
 #define TIMER_ONESHOT_REL 1
 #define TIMER_ONESHOT_ABS 0
+#define TIMER_UNIT_NS     2  // timeout をミリ秒ではなくナノ秒で指定する
 struct SyscallResult SyscallCreateTimer(
-    unsigned int type, int timer_value, unsigned long timeout_ms);
+    unsigned int type, int timer_value, unsigned long timeout);
 
 struct SyscallResult SyscallOpenFile(const char* path, int flags);
 struct SyscallResult SyscallReadFile(int fd, void* buf, size_t count);
 struct SyscallResult SyscallDemandPages(size_t num_pages, int flags);
 struct SyscallResult SyscallMapFile(int fd, size_t* file_size, int flags);
 struct SyscallResult SyscallIsTerminal(int fd);
+struct SyscallResult SyscallGetCurrentTimeNs();
+struct SyscallResult SyscallSetDeadline(
+    uint64_t runtime_ns, uint64_t period_ns, uint64_t deadline_ns);
+struct SyscallResult SyscallGetTaskStats(
+    int mode, struct TaskStats* stats, size_t count);
+struct SyscallResult SyscallWinDrawBatch(
+    uint64_t layer_id_flags, const struct DrawOp* ops, size_t count);
+struct SyscallResult SyscallWinMapSurface(
+    uint64_t layer_id_flags, struct WindowSurface* surface);
+struct SyscallResult SyscallWinCommit(
+    uint64_t layer_id_flags, int x, int y, int w, int h);
+struct SyscallResult SyscallWinSetAlphaBlending(
+    uint64_t layer_id_flags, int enable);
 
 #ifdef __cplusplus
 } // extern "C"
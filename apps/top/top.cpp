@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <cstring>
+#include "../syscall.h"
+
+const int kMaxTasks = 32;
+const int kRows = 20;
+const int kWidth = 8 * 72, kHeight = 16 * (kRows + 1) + 8;
+const unsigned long kRefreshNs = 1'000'000'000;
+
+TaskStats stats[kMaxTasks], prev_stats[kMaxTasks];
+size_t num_prev = 0;
+
+// 前回の表示から CPU を使った時間 (ns)
+uint64_t CPUDelta(const TaskStats& s) {
+  const uint64_t total = s.user_ns + s.kernel_ns;
+  for (size_t i = 0; i < num_prev; ++i) {
+    if (prev_stats[i].id == s.id) {
+      return total - (prev_stats[i].user_ns + prev_stats[i].kernel_ns);
+    }
+  }
+  return total;
+}
+
+void Draw(uint64_t layer_id, size_t n, uint64_t elapsed_ns) {
+  SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
+                          4, 24, kWidth, kHeight, 0x000000);
+  SyscallWinWriteString(layer_id | LAYER_NO_REDRAW, 4, 24, 0xffff00,
+      "  ID LV NICE  CPU%  USER(ms)  KERN(ms)   VCSW   ICSW    PF   SYSC MQ");
+
+  char line[128];
+  for (size_t i = 0; i < n && i < kRows; ++i) {
+    const auto& s = stats[i];
+    const uint64_t permille = elapsed_ns ? CPUDelta(s) * 1000 / elapsed_ns : 0;
+    snprintf(line, sizeof(line),
+             "%4lu %2d %4d %3lu.%lu %9lu %9lu %6lu %6lu %5lu %6lu %2lu",
+             s.id, s.level, s.nice, permille / 10, permille % 10,
+             s.user_ns / 1'000'000, s.kernel_ns / 1'000'000,
+             s.voluntary_switches, s.involuntary_switches,
+             s.page_faults, s.syscalls, s.msg_queue_max);
+    SyscallWinWriteString(layer_id | LAYER_NO_REDRAW, 4, 24 + 16 * (i + 1),
+                          s.running ? 0xffffff : 0x808080, line);
+  }
+  SyscallWinRedraw(layer_id);
+}
+
+int main(int argc, char** argv) {
+  auto [layer_id, err_openwin]
+    = SyscallOpenWindow(kWidth + 8, kHeight + 28, 10, 10, "top");
+  if (err_openwin) {
+    return err_openwin;
+  }
+
+  uint64_t prev_ns = SyscallGetCurrentTimeNs().value;
+  AppEvent events[1];
+  for (;;) {
+    const uint64_t now_ns = SyscallGetCurrentTimeNs().value;
+    const size_t n = SyscallGetTaskStats(TASK_STATS_ALL, stats, kMaxTasks).value;
+    Draw(layer_id, n, now_ns - prev_ns);
+    memcpy(prev_stats, stats, sizeof(stats[0]) * n);
+    num_prev = n;
+    prev_ns = now_ns;
+
+    SyscallCreateTimer(TIMER_ONESHOT_REL | TIMER_UNIT_NS, 1, kRefreshNs);
+    for (;;) {
+      SyscallReadEvent(events, 1);
+      if (events[0].type == AppEvent::kTimerTimeout) {
+        break;
+      } else if (events[0].type == AppEvent::kQuit) {
+        SyscallCloseWindow(layer_id);
+        return 0;
+      }
+    }
+  }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file app_draw.hpp
+ *
+ * WinDrawBatch システムコールで渡す描画命令と，WinMapSurface で得られる
+ * ウィンドウの影バッファの定義．
+ * アプリからも読み込まれるため C 言語と互換な記述にする．
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief 1 回の WinDrawBatch で渡せる描画命令の最大数 */
+#define DRAW_BATCH_MAX 4096
+
+#define DRAW_OP_FILL_RECT 1  // (x0, y0) から幅 x1，高さ y1 の矩形を color で塗る
+#define DRAW_OP_LINE      2  // (x0, y0) から (x1, y1) へ color で線を引く
+#define DRAW_OP_STRING    3  // (x0, y0) に data の指す NUL 終端文字列を color で描く
+#define DRAW_OP_BLIT      4  // (x0, y0) に data の指す 0xRRGGBB の画素を幅 x1，高さ y1 で描く
+
+struct DrawOp {
+  uint32_t type;     // DRAW_OP_*
+  uint32_t color;    // 0xRRGGBB（DRAW_OP_BLIT では使わない）
+  int32_t x0, y0;
+  int32_t x1, y1;
+  const void* data;  // DRAW_OP_STRING と DRAW_OP_BLIT で使う
+};
+
+static inline struct DrawOp DrawOpFillRect(int x, int y, int w, int h, uint32_t color) {
+  struct DrawOp op = { DRAW_OP_FILL_RECT, color, x, y, w, h, 0 };
+  return op;
+}
+
+static inline struct DrawOp DrawOpLine(int x0, int y0, int x1, int y1, uint32_t color) {
+  struct DrawOp op = { DRAW_OP_LINE, color, x0, y0, x1, y1, 0 };
+  return op;
+}
+
+static inline struct DrawOp DrawOpString(int x, int y, uint32_t color, const char* s) {
+  struct DrawOp op = { DRAW_OP_STRING, color, x, y, 0, 0, s };
+  return op;
+}
+
+static inline struct DrawOp DrawOpBlit(int x, int y, int w, int h, const uint32_t* pixels) {
+  struct DrawOp op = { DRAW_OP_BLIT, 0, x, y, w, h, pixels };
+  return op;
+}
+
+#define SURFACE_FORMAT_RGB 0  // ピクセルは 0xAABBGGRR
+#define SURFACE_FORMAT_BGR 1  // ピクセルは 0xAARRGGBB
+
+/** @brief アプリのアドレス空間に割り当てたウィンドウの影バッファ．
+ *
+ * 書き込んだ後は WinCommit で変更した範囲を知らせると画面に反映される．
+ */
+struct WindowSurface {
+  uint32_t* pixels;  // ウィンドウ左上のピクセル（タイトルバーや枠も含む）
+  uint32_t stride;   // 1 行のピクセル数（width 以上）
+  int32_t width, height;
+  uint32_t format;   // SURFACE_FORMAT_*
+};
+
+/** @brief 0xRRGGBB 形式の色を surface のピクセル形式（不透明）に変換する */
+static inline uint32_t SurfacePixel(const struct WindowSurface* surface, uint32_t rgb) {
+  if (surface->format == SURFACE_FORMAT_RGB) {
+    rgb = (rgb >> 16 & 0xff) | (rgb & 0xff00) | (rgb & 0xff) << 16;
+  }
+  return 0xff000000u | rgb;
+}
+
+/**
+ * @brief 0xAARRGGBB 形式の色を surface のピクセル形式（乗算済みアルファ）に変換する．
+ *
+ * WinSetAlphaBlending で合成を有効にしたウィンドウに書くときに使う．
+ */
+static inline uint32_t SurfacePixelARGB(const struct WindowSurface* surface, uint32_t argb) {
+  const uint32_t a = argb >> 24;
+  const uint32_t r = (argb >> 16 & 0xff) * a / 255;
+  const uint32_t g = (argb >> 8 & 0xff) * a / 255;
+  const uint32_t b = (argb & 0xff) * a / 255;
+  return (SurfacePixel(surface, r << 16 | g << 8 | b) & 0x00ffffffu) | a << 24;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
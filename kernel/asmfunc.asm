@@ -19,6 +19,19 @@ IoIn32:
     in eax, dx
     ret
 
+global IoOut8  ; void IoOut8(uint16_t addr, uint8_t data);
+IoOut8:
+    mov dx, di    ; dx = addr
+    mov al, sil   ; al = data
+    out dx, al
+    ret
+
+global IoIn8  ; uint8_t IoIn8(uint16_t addr);
+IoIn8:
+    mov dx, di    ; dx = addr
+    in al, dx
+    ret
+
 global GetCS  ; uint16_t GetCS(void);
 GetCS:
     xor eax, eax  ; also clears upper 32 bits of rax
@@ -96,6 +109,25 @@ GetCR3:
     mov rax, cr3
     ret
 
+global GetCR4  ; uint64_t GetCR4();
+GetCR4:
+    mov rax, cr4
+    ret
+
+global SetCR4  ; void SetCR4(uint64_t value);
+SetCR4:
+    mov cr4, rdi
+    ret
+
+global SetXCR0  ; void SetXCR0(uint64_t value);
+SetXCR0:
+    mov rax, rdi
+    mov rdx, rdi
+    shr rdx, 32
+    xor ecx, ecx
+    xsetbv
+    ret
+
 extern kernel_main_stack
 extern KernelMainNewStack
 
@@ -145,7 +177,7 @@ SwitchContext:  ; void SwitchContext(void* next_ctx, void* current_ctx);
     mov dx, gs
     mov [rsi + 0x38], rdx
 
-    fxsave [rsi + 0xc0]
+    ; FPU/SSE の状態は保存しない（#NM で必要になったときに保存する）
     ; fall through to RestoreContext
 
 global RestoreContext
@@ -158,7 +190,10 @@ RestoreContext:  ; void RestoreContext(void* task_context);
     push qword [rdi + 0x08] ; RIP
 
     ; コンテキストの復帰
-    fxrstor [rdi + 0xc0]
+    ; CR0.TS を立て，次のタスクが FPU/SSE を使ったときに #NM を発生させる
+    mov rax, cr0
+    or rax, 8
+    mov cr0, rax
 
     mov rax, [rdi + 0x00]
     mov cr3, rax
@@ -186,6 +221,68 @@ RestoreContext:  ; void RestoreContext(void* task_context);
 
     o64 iret
 
+global RestoreContextWithFPU
+RestoreContextWithFPU:  ; void RestoreContextWithFPU(void* task_context,
+                        ;                            const void* fxsave_area);
+    ; 割り込み時点の FPU/SSE レジスタの値を戻してから切り替える（CR0.TS = 0 で呼ぶこと）
+    fxrstor [rsi]
+    jmp RestoreContext
+
+extern SwitchFPUOwner
+; FPUSwitch SwitchFPUOwner();
+extern fpu_save_mode
+
+global IntHandlerNM
+IntHandlerNM:  ; void IntHandlerNM();
+    push rbp
+    mov rbp, rsp
+    push rax
+    push rdx
+    push rsi
+    push rdi
+    and rsp, 0xfffffffffffffff0
+
+    clts
+    call SwitchFPUOwner  ; RAX: 保存先, RDX: 復帰元
+    mov rsi, rax
+    mov rdi, rdx
+    cmp dword [fpu_save_mode], 0  ; kFPUSaveFXSAVE
+    jne .xsave
+
+    test rsi, rsi
+    jz .fxrstor
+    fxsave [rsi]
+.fxrstor:
+    test rdi, rdi
+    jz .exit
+    fxrstor [rdi]
+    jmp .exit
+
+.xsave:
+    mov eax, 0xffffffff  ; XCR0 で有効なすべての状態を対象にする
+    mov edx, eax
+    test rsi, rsi
+    jz .xrstor
+    cmp dword [fpu_save_mode], 2  ; kFPUSaveXSAVEOPT
+    je .xsaveopt
+    xsave [rsi]
+    jmp .xrstor
+.xsaveopt:
+    xsaveopt [rsi]
+.xrstor:
+    test rdi, rdi
+    jz .exit
+    xrstor [rdi]
+
+.exit:
+    lea rsp, [rbp - 32]
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rax
+    pop rbp
+    iretq
+
 global CallApp
 CallApp:  ; int CallApp(int argc, char** argv, uint16_t ss,
           ;             uint64_t rip, uint64_t rsp, uint64_t* os_stack_ptr);
@@ -215,7 +312,6 @@ IntHandlerLAPICTimer:  ; void IntHandlerLAPICTimer();
 
     ; スタック上に TaskContext 型の構造を構築する
     sub rsp, 512
-    fxsave [rsp]
     push r15
     push r14
     push r13
@@ -236,19 +332,29 @@ IntHandlerLAPICTimer:  ; void IntHandlerLAPICTimer();
     mov ax, fs
     mov bx, gs
     mov rcx, cr3
+    mov rdx, cr0
 
     push rbx                 ; GS
     push rax                 ; FS
     push qword [rbp + 0x28]  ; SS
     push qword [rbp + 0x10]  ; CS
-    push rbp                 ; reserved1
+    push rdx                 ; reserved1 (CR0)
     push qword [rbp + 0x18]  ; RFLAGS
     push qword [rbp + 0x08]  ; RIP
     push rcx                 ; CR3
 
+    ; 割り込みハンドラ内で SSE を使えるよう，割り込み時点のレジスタを退避する
+    ; カーネルは VEX 符号化命令を使わないので，YMM/ZMM の上位ビットは壊れない
+    clts
+    fxsave [rbp - 512]
+
     mov rdi, rsp
     call LAPICTimerOnInterrupt
 
+    fxrstor [rbp - 512]
+    mov rax, [rsp + 0x18]
+    mov cr0, rax  ; CR0.TS を割り込み前の状態に戻す
+
     add rsp, 8*8  ; CR3 から GS までを無視
     pop rax
     pop rbx
@@ -265,7 +371,6 @@ IntHandlerLAPICTimer:  ; void IntHandlerLAPICTimer();
     pop r13
     pop r14
     pop r15
-    fxrstor [rsp]
 
     mov rsp, rbp
     pop rbp
@@ -285,7 +390,32 @@ WriteMSR:  ; void WriteMSR(uint32_t msr, uint64_t value);
     wrmsr
     ret
 
+global ReadTSC
+ReadTSC:  ; uint64_t ReadTSC();
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+global CPUID
+CPUID:  ; void CPUID(uint32_t leaf, uint32_t subleaf,
+        ;            uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d);
+    push rbx  ; rbx は callee-saved
+    mov r10, rdx
+    mov r11, rcx
+    mov eax, edi
+    mov ecx, esi
+    cpuid
+    mov [r10], eax
+    mov [r11], ebx
+    mov [r8], ecx
+    mov [r9], edx
+    pop rbx
+    ret
+
 extern GetCurrentTaskOSStackPointer
+extern SyscallEntered
+extern SyscallReturning
 extern syscall_table
 global SyscallEntry
 SyscallEntry:  ; void SyscallEntry(void);
@@ -316,10 +446,25 @@ SyscallEntry:  ; void SyscallEntry(void);
     pop rax
     and rsp, 0xfffffffffffffff0
 
+    push rdi
+    sub rsp, 8
+    mov edi, eax  ; システムコール番号
+    cli
+    call SyscallEntered  ; ここからの時間をカーネルモードとして計上する
+    sti
+    add rsp, 8
+    pop rdi
+
     call [syscall_table + 8 * eax]
     ; rbx, r12-r15 は callee-saved なので呼び出し側で保存しない
     ; rax は戻り値用なので呼び出し側で保存しない
 
+    mov rdi, [rbp]  ; システムコール番号
+    mov esi, edx    ; エラー番号
+    cli
+    call SyscallReturning  ; rax, rdx（戻り値）は壊さない
+    sti
+
     mov rsp, rbp
 
     pop rsi  ; システムコール番号を復帰
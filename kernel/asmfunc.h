@@ -5,6 +5,8 @@
 extern "C" {
   void IoOut32(uint16_t addr, uint32_t data);
   uint32_t IoIn32(uint16_t addr);
+  void IoOut8(uint16_t addr, uint8_t data);
+  uint8_t IoIn8(uint16_t addr);
   uint16_t GetCS(void);
   void LoadIDT(uint16_t limit, uint64_t offset);
   void LoadGDT(uint16_t limit, uint64_t offset);
@@ -15,12 +17,20 @@ extern "C" {
   uint64_t GetCR2();
   void SetCR3(uint64_t value);
   uint64_t GetCR3();
+  uint64_t GetCR4();
+  void SetCR4(uint64_t value);
+  void SetXCR0(uint64_t value);
   void SwitchContext(void* next_ctx, void* current_ctx);
   void RestoreContext(void* ctx);
+  void RestoreContextWithFPU(void* ctx, const void* fxsave_area);
   int CallApp(int argc, char** argv, uint16_t ss, uint64_t rip, uint64_t rsp, uint64_t* os_stack_ptr);
   void IntHandlerLAPICTimer();
+  void IntHandlerNM();
   void LoadTR(uint16_t sel);
   void WriteMSR(uint32_t msr, uint64_t value);
+  uint64_t ReadTSC();
+  void CPUID(uint32_t leaf, uint32_t subleaf,
+             uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d);
   void SyscallEntry(void);
   void ExitApp(uint64_t rsp, int32_t ret_val);
   void InvalidateTLB(uint64_t addr);
@@ -0,0 +1,320 @@
+#include "blit.hpp"
+
+#include <immintrin.h>
+
+#include "asmfunc.h"
+#include "fpu.hpp"
+#include "logger.hpp"
+
+namespace {
+  /* 1 バイトのビットマップを 8 ピクセル分のマスク（ビットが立つ位置は 0xffffffff）に
+   * 広げた表．グリフの 1 行をビット演算なしでマスク付きストアにできる．
+   */
+  struct ByteLaneMasks {
+    alignas(32) uint32_t lanes[256][8];
+
+    constexpr ByteLaneMasks() : lanes{} {
+      for (int b = 0; b < 256; ++b) {
+        for (int i = 0; i < 8; ++i) {
+          lanes[b][i] = (b & (0x80 >> i)) ? 0xffffffffu : 0;
+        }
+      }
+    }
+  };
+  constexpr ByteLaneMasks kByteLaneMasks{};
+
+  // 素朴な実装．ベンチマークで SIMD 版と比べるために残す
+  void CopyScalar(uint32_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = src[i];
+    }
+  }
+
+  void CopyKeyScalar(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key) {
+    for (size_t i = 0; i < n; ++i) {
+      if (src[i] != key) {
+        dst[i] = src[i];
+      }
+    }
+  }
+
+  void FillScalar(uint32_t* dst, size_t n, uint32_t v) {
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = v;
+    }
+  }
+
+  // x / 255 を x < 65536 の範囲で正確に求める
+  uint32_t Div255(uint32_t x) {
+    return (x + 1 + (x >> 8)) >> 8;
+  }
+
+  uint32_t BlendPixel(uint32_t d, uint32_t s) {
+    const uint32_t a = s >> 24;
+    if (a == 0xff) {
+      return s;
+    } else if (a == 0) {
+      return d;
+    }
+    uint32_t r = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      const uint32_t c = ((s >> shift) & 0xff) + Div255(((d >> shift) & 0xff) * (255 - a));
+      r |= (c > 0xff ? 0xff : c) << shift;
+    }
+    return r;
+  }
+
+  void BlendScalar(uint32_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = BlendPixel(dst[i], src[i]);
+    }
+  }
+
+  void Glyph8Scalar(uint32_t* dst, size_t stride, const uint8_t* rows, int num_rows,
+                    uint32_t v) {
+    for (int y = 0; y < num_rows; ++y, dst += stride) {
+      for (int x = 0; x < 8; ++x) {
+        if (rows[y] & (0x80u >> x)) {
+          dst[x] = v;
+        }
+      }
+    }
+  }
+
+  /* 以下の SIMD 版は本体を 4 または 8 ピクセル単位で処理し，端数を 1 ピクセルずつ処理する．
+   * 行の先頭は揃っているとは限らないので，非整列のロード・ストアを使う．
+   */
+
+  void CopySSE2(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+    }
+    for (; i < n; ++i) {
+      dst[i] = src[i];
+    }
+  }
+
+  // dst = (src == key) ? dst : src
+  void CopyKeySSE2(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key) {
+    const __m128i k = _mm_set1_epi32(key);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+      const __m128i transparent = _mm_cmpeq_epi32(s, k);
+      const __m128i r = _mm_or_si128(_mm_and_si128(transparent, d),
+                                     _mm_andnot_si128(transparent, s));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+    }
+    for (; i < n; ++i) {
+      if (src[i] != key) {
+        dst[i] = src[i];
+      }
+    }
+  }
+
+  void FillSSE2(uint32_t* dst, size_t n, uint32_t v) {
+    const __m128i x = _mm_set1_epi32(v);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), x);
+    }
+    for (; i < n; ++i) {
+      dst[i] = v;
+    }
+  }
+
+  // 16 ビットに広げた 2 ピクセル分について dst * (255 - a) / 255 を求める
+  __m128i ScaleByInvAlphaSSE2(__m128i d16, __m128i s16) {
+    __m128i a = _mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i x = _mm_mullo_epi16(d16, _mm_sub_epi16(_mm_set1_epi16(255), a));
+    // Div255
+    return _mm_srli_epi16(
+        _mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+  }
+
+  void BlendSSE2(uint32_t* dst, const uint32_t* src, size_t n) {
+    const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      const __m128i a = _mm_and_si128(s, alpha_mask);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, alpha_mask)) == 0xffff) { // すべて不透明
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+        continue;
+      } else if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xffff) { // すべて透明
+        continue;
+      }
+
+      const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+      const __m128i lo = ScaleByInvAlphaSSE2(_mm_unpacklo_epi8(d, zero),
+                                             _mm_unpacklo_epi8(s, zero));
+      const __m128i hi = ScaleByInvAlphaSSE2(_mm_unpackhi_epi8(d, zero),
+                                             _mm_unpackhi_epi8(s, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                       _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = BlendPixel(dst[i], src[i]);
+    }
+  }
+
+  void Glyph8SSE2(uint32_t* dst, size_t stride, const uint8_t* rows, int num_rows,
+                  uint32_t v) {
+    const __m128i color = _mm_set1_epi32(v);
+    for (int y = 0; y < num_rows; ++y, dst += stride) {
+      if (rows[y] == 0) {
+        continue;
+      }
+      const auto m = reinterpret_cast<const __m128i*>(kByteLaneMasks.lanes[rows[y]]);
+      auto p = reinterpret_cast<__m128i*>(dst);
+      for (int half = 0; half < 2; ++half) {
+        const __m128i mask = _mm_load_si128(m + half);
+        const __m128i d = _mm_loadu_si128(p + half);
+        _mm_storeu_si128(p + half, _mm_or_si128(_mm_and_si128(mask, color),
+                                                _mm_andnot_si128(mask, d)));
+      }
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void CopyAVX2(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      const __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      const __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), s0);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), s1);
+    }
+    for (; i + 8 <= n; i += 8) {
+      const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), s);
+    }
+    for (; i < n; ++i) {
+      dst[i] = src[i];
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void CopyKeyAVX2(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key) {
+    const __m256i k = _mm256_set1_epi32(key);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+      const __m256i transparent = _mm256_cmpeq_epi32(s, k);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                          _mm256_blendv_epi8(s, d, transparent));
+    }
+    for (; i < n; ++i) {
+      if (src[i] != key) {
+        dst[i] = src[i];
+      }
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void FillAVX2(uint32_t* dst, size_t n, uint32_t v) {
+    const __m256i x = _mm256_set1_epi32(v);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), x);
+    }
+    for (; i < n; ++i) {
+      dst[i] = v;
+    }
+  }
+
+  __attribute__((target("avx2")))
+  __m256i ScaleByInvAlphaAVX2(__m256i d16, __m256i s16) {
+    __m256i a = _mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m256i x = _mm256_mullo_epi16(d16, _mm256_sub_epi16(_mm256_set1_epi16(255), a));
+    return _mm256_srli_epi16(
+        _mm256_add_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8)), 8);
+  }
+
+  __attribute__((target("avx2")))
+  void BlendAVX2(uint32_t* dst, const uint32_t* src, size_t n) {
+    const __m256i alpha_mask = _mm256_set1_epi32(0xff000000);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      const __m256i a = _mm256_and_si256(s, alpha_mask);
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, alpha_mask)) == -1) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), s);
+        continue;
+      } else if (_mm256_testz_si256(s, alpha_mask)) {
+        continue;
+      }
+
+      // unpack は 128 ビットのレーンごとに働くが，pack で同じ並びに戻るので問題ない
+      const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+      const __m256i lo = ScaleByInvAlphaAVX2(_mm256_unpacklo_epi8(d, zero),
+                                             _mm256_unpacklo_epi8(s, zero));
+      const __m256i hi = ScaleByInvAlphaAVX2(_mm256_unpackhi_epi8(d, zero),
+                                             _mm256_unpackhi_epi8(s, zero));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                          _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = BlendPixel(dst[i], src[i]);
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void Glyph8AVX2(uint32_t* dst, size_t stride, const uint8_t* rows, int num_rows,
+                  uint32_t v) {
+    const __m256i color = _mm256_set1_epi32(v);
+    for (int y = 0; y < num_rows; ++y, dst += stride) {
+      const __m256i mask = _mm256_load_si256(
+          reinterpret_cast<const __m256i*>(kByteLaneMasks.lanes[rows[y]]));
+      _mm256_maskstore_epi32(reinterpret_cast<int*>(dst), mask, color);
+    }
+  }
+
+  const BlitKernels kScalarKernels{
+    "scalar", CopyScalar, CopyKeyScalar, FillScalar, BlendScalar, Glyph8Scalar};
+  const BlitKernels kSSE2Kernels{
+    "sse2", CopySSE2, CopyKeySSE2, FillSSE2, BlendSSE2, Glyph8SSE2};
+  const BlitKernels kAVX2Kernels{
+    "avx2", CopyAVX2, CopyKeyAVX2, FillAVX2, BlendAVX2, Glyph8AVX2};
+
+  const BlitKernels* available_kernels[3] = {&kScalarKernels, &kSSE2Kernels};
+  size_t num_available_kernels = 2;
+
+  bool HasAVX2() {
+    // AVX の状態を XSAVE で保存できなければ，タスク切り替えで上位 128 ビットが壊れる
+    if (!fpu_avx_enabled) {
+      return false;
+    }
+    uint32_t a, b, c, d;
+    CPUID(0, 0, &a, &b, &c, &d);
+    if (a < 7) {
+      return false;
+    }
+    CPUID(7, 0, &a, &b, &c, &d);
+    return b & (1u << 5);
+  }
+}
+
+// x86-64 では SSE2 は必ず使える
+const BlitKernels* blit_kernels = &kSSE2Kernels;
+
+void InitializeBlit() {
+  if (HasAVX2()) {
+    available_kernels[num_available_kernels++] = &kAVX2Kernels;
+    blit_kernels = &kAVX2Kernels;
+  }
+  Log(kInfo, "blit kernels: %s\n", blit_kernels->name);
+}
+
+const BlitKernels* const* AvailableBlitKernels(size_t& count) {
+  count = num_available_kernels;
+  return available_kernels;
+}
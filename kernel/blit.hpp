@@ -0,0 +1,65 @@
+/**
+ * @file blit.hpp
+ *
+ * 32 ビットピクセルの行をまとめて扱う転送・塗りつぶし処理．
+ * CPU の対応状況に応じて SSE2 版か AVX2 版を選ぶ．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** @brief 1 組の転送処理の実装 */
+struct BlitKernels {
+  const char* name;
+  /** @brief src から dst へ n ピクセルを複写する（領域は重ならないこと） */
+  void (*copy)(uint32_t* dst, const uint32_t* src, size_t n);
+  /** @brief src のうち key と異なるピクセルだけを dst へ複写する */
+  void (*copy_key)(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key);
+  /** @brief dst の n ピクセルを v で埋める */
+  void (*fill)(uint32_t* dst, size_t n, uint32_t v);
+  /** @brief 最上位バイトをアルファ値とする乗算済みの src を dst に重ねる（dst = src + dst * (255 - a) / 255） */
+  void (*blend)(uint32_t* dst, const uint32_t* src, size_t n);
+  /** @brief 幅 8 ピクセルのグリフを描く．rows[y] のビット（MSB が左）が立つピクセルを v にする
+   *
+   * @param stride  dst の 1 行のピクセル数
+   */
+  void (*glyph8)(uint32_t* dst, size_t stride, const uint8_t* rows, int num_rows, uint32_t v);
+};
+
+/** @brief 現在使っている実装．InitializeBlit() までは SSE2 版を指す． */
+extern const BlitKernels* blit_kernels;
+
+/** @brief CPU とこのカーネルが有効にした拡張命令を調べ，最速の実装を選ぶ．
+ *
+ * InitializeFPU() の後で呼ぶこと．
+ */
+void InitializeBlit();
+
+/** @brief この CPU で使える実装の一覧を返す（ベンチマーク用）．
+ *
+ * @param count  一覧の要素数を書き込む
+ */
+const BlitKernels* const* AvailableBlitKernels(size_t& count);
+
+inline void CopyPixels(uint32_t* dst, const uint32_t* src, size_t n) {
+  blit_kernels->copy(dst, src, n);
+}
+
+inline void CopyPixelsColorKey(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key) {
+  blit_kernels->copy_key(dst, src, n, key);
+}
+
+inline void FillPixels(uint32_t* dst, size_t n, uint32_t v) {
+  blit_kernels->fill(dst, n, v);
+}
+
+inline void BlendPixels(uint32_t* dst, const uint32_t* src, size_t n) {
+  blit_kernels->blend(dst, src, n);
+}
+
+inline void DrawGlyph8(uint32_t* dst, size_t stride, const uint8_t* rows, int num_rows,
+                       uint32_t v) {
+  blit_kernels->glyph8(dst, stride, rows, num_rows, v);
+}
@@ -6,6 +6,7 @@
 
 #include "console.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include "font.hpp"
 #include "layer.hpp"
@@ -16,18 +17,35 @@ Console::Console(const PixelColor& fg_color, const PixelColor& bg_color)
 }
 
 void Console::PutString(const char* s) {
-  while (*s) {
+  PutString(s, strlen(s));
+}
+
+void Console::PutString(const char* s, size_t len) {
+  int first_row = cursor_row_; // 描き変えた最初の行
+  const char* const end = s + len;
+  while (s < end) {
     if (*s == '\n') {
-      Newline();
-    } else if (cursor_column_ < kColumns - 1) {
-      WriteAscii(*writer_, Vector2D<int>{8 * cursor_column_, 16 * cursor_row_}, *s, fg_color_);
-      buffer_[cursor_row_][cursor_column_] = *s;
-      ++cursor_column_;
+      if (Newline()) {
+        first_row = 0;
+      }
+      ++s;
+      continue;
+    }
+
+    // 改行までの文字はまとめて描く．行に収まらない分は捨てる
+    const char* run_end = std::find(s, end, '\n');
+    const int n = std::min<int>(run_end - s, kColumns - 1 - cursor_column_);
+    if (n > 0) {
+      WriteAsciiString(*writer_, Vector2D<int>{8 * cursor_column_, 16 * cursor_row_},
+                       s, n, fg_color_);
+      memcpy(&buffer_[cursor_row_][cursor_column_], s, n);
+      cursor_column_ += n;
     }
-    ++s;
+    s = run_end;
   }
   if (layer_manager) {
-    layer_manager->Draw(layer_id_);
+    layer_manager->Draw(layer_id_, {{0, 16 * first_row},
+                                    {8 * kColumns, 16 * (cursor_row_ - first_row + 1)}});
   }
 }
 
@@ -57,25 +75,26 @@ unsigned int Console::LayerID() const {
   return layer_id_;
 }
 
-void Console::Newline() {
+bool Console::Newline() {
   cursor_column_ = 0;
   if (cursor_row_ < kRows - 1) {
     ++cursor_row_;
-    return;
+    return false;
+  }
+
+  for (int row = 0; row < kRows - 1; ++row) {
+    memcpy(buffer_[row], buffer_[row + 1], kColumns + 1);
   }
+  memset(buffer_[kRows - 1], 0, kColumns + 1);
 
   if (window_) {
     Rectangle<int> move_src{{0, 16}, {8 * kColumns, 16 * (kRows - 1)}};
     window_->Move({0, 0}, move_src);
     FillRectangle(*writer_, {0, 16 * (kRows - 1)}, {8 * kColumns, 16}, bg_color_);
   } else {
-    FillRectangle(*writer_, {0, 0}, {8 * kColumns, 16 * kRows}, bg_color_);
-    for (int row = 0; row < kRows - 1; ++row) {
-      memcpy(buffer_[row], buffer_[row + 1], kColumns + 1);
-      WriteString(*writer_, Vector2D<int>{0, 16 * row}, buffer_[row], fg_color_);
-    }
-    memset(buffer_[kRows - 1], 0, kColumns + 1);
+    Refresh();
   }
+  return true;
 }
 
 void Console::Refresh() {
@@ -10,13 +10,15 @@ class Console {
 
   Console(const PixelColor& fg_color, const PixelColor& bg_color);
   void PutString(const char* s);
+  void PutString(const char* s, size_t len);
   void SetWriter(PixelWriter* writer);
   void SetWindow(const std::shared_ptr<Window>& window);
   void SetLayerID(unsigned int layer_id);
   unsigned int LayerID() const;
 
  private:
-  void Newline();
+  /** @brief 改行する．画面がスクロールしたら true を返す */
+  bool Newline();
   void Refresh();
 
   PixelWriter* writer_;
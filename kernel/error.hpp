@@ -36,6 +36,7 @@ class Error {
     kNoSuchEntry,
     kFreeTypeError,
     kEndpointNotInCharge,
+    kBandwidthExceeded,
     kLastOfCode,  // この列挙子は常に最後に配置する
   };
 
@@ -71,6 +72,7 @@ class Error {
     "kNoSuchEntry",
     "kFreeTypeError",
     "kEndpointNotInCharge",
+    "kBandwidthExceeded",
   };
   static_assert(Error::Code::kLastOfCode == code_names_.size());
 
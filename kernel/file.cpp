@@ -1,28 +1,162 @@
 #include "file.hpp"
 
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
 #include <cstdio>
-#include <vector>
+#include <cstdlib>
+#include <cstring>
 
+namespace {
+  // 出力を小さなバッファにためて，いっぱいになるたびに fd に書き込む．
+  // 渡された断片は分割しないので，UTF-8 の文字が 2 回の書き込みにまたがることはない
+  class FDWriter {
+   public:
+    FDWriter(FileDescriptor& fd) : fd_{fd} {}
+
+    void Put(const char* s, size_t len) {
+      if (used_ + len > sizeof(buf_)) {
+        Flush();
+      }
+      if (len >= sizeof(buf_)) {
+        fd_.Write(s, len);
+      } else {
+        memcpy(&buf_[used_], s, len);
+        used_ += len;
+      }
+      total_ += len;
+    }
+
+    void Fill(char c, size_t n) {
+      for (; n > 0; --n) {
+        Put(&c, 1);
+      }
+    }
+
+    void Flush() {
+      if (used_ > 0) {
+        fd_.Write(buf_, used_);
+        used_ = 0;
+      }
+    }
+
+    size_t Total() const { return total_; }
+
+   private:
+    FileDescriptor& fd_;
+    char buf_[256];
+    size_t used_{0}, total_{0};
+  };
+
+  // 幅と精度（ともに数字のみ）を読み取る．指定がなければ -1
+  void ParseWidthPrecision(const char* spec, bool& left, int& width, int& precision) {
+    const char* p = spec + 1;
+    left = false;
+    for (; *p && strchr("-+ #0", *p); ++p) {
+      left |= *p == '-';
+    }
+    width = precision = -1;
+    if ('0' <= *p && *p <= '9') {
+      char* end;
+      width = strtol(p, &end, 10);
+      p = end;
+    }
+    if (*p == '.') {
+      precision = strtol(p + 1, nullptr, 10);
+    }
+  }
+}
+
+/* 書式を先頭から 1 回だけ走査し，変換指定ごとに整形して書き込む．
+ * 全体を 1 つのバッファに整形しないので，出力がどれだけ長くてもヒープを使わない．
+ * 幅や精度の * と浮動小数点数の変換には対応しない（カーネルでは使っていない）．
+ */
 size_t PrintToFD(FileDescriptor& fd, const char* format, ...) {
-  constexpr int BUFFER_SIZE = 128;
+  FDWriter out{fd};
   va_list ap;
-  int result;
-  char s[BUFFER_SIZE];
-
   va_start(ap, format);
-  result = vsnprintf(s, BUFFER_SIZE, format, ap);
-  va_end(ap);
-  if (result < BUFFER_SIZE) {
-    fd.Write(s, result);
-    return result;
+
+  const char* p = format;
+  while (*p) {
+    const char* pct = strchr(p, '%');
+    if (pct == nullptr) {
+      out.Put(p, strlen(p));
+      break;
+    }
+    out.Put(p, pct - p);
+
+    // 変換指定を 1 つ切り出す: %[フラグ][幅][.精度][長さ修飾子]変換
+    const char* q = pct + 1;
+    q += strspn(q, "-+ #0");
+    q += strspn(q, "0123456789");
+    if (*q == '.') {
+      q += 1 + strspn(q + 1, "0123456789");
+    }
+    const char* length = q;
+    q += strspn(q, "hlzjt");
+    const char conv = *q;
+    char spec[16];
+    if (conv == '\0' || q + 1 - pct >= static_cast<ptrdiff_t>(sizeof(spec))) {
+      out.Put(pct, strlen(pct));
+      break;
+    }
+    ++q;
+    memcpy(spec, pct, q - pct);
+    spec[q - pct] = '\0';
+    p = q;
+
+    char tmp[64];
+    int n = -1;
+    switch (conv) {
+    case '%':
+      out.Put("%", 1);
+      break;
+    case 's': {
+      // 文字列は長くなりうるので，整形せずに幅をそろえてそのまま書き込む
+      const char* str = va_arg(ap, const char*);
+      if (str == nullptr) {
+        str = "(null)";
+      }
+      bool left;
+      int width, precision;
+      ParseWidthPrecision(spec, left, width, precision);
+      const size_t len = precision >= 0 ? strnlen(str, precision) : strlen(str);
+      const size_t pad = width > 0 && static_cast<size_t>(width) > len ? width - len : 0;
+      if (!left) {
+        out.Fill(' ', pad);
+      }
+      out.Put(str, len);
+      if (left) {
+        out.Fill(' ', pad);
+      }
+      break;
+    }
+    case 'c':
+      n = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, int));
+      break;
+    case 'p':
+      n = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, void*));
+      break;
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+      if (strncmp(length, "ll", 2) == 0 || *length == 'j') {
+        n = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, long long));
+      } else if (*length == 'l' || *length == 'z' || *length == 't') {
+        n = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, long));
+      } else {
+        n = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, int));
+      }
+      break;
+    default: // 対応していない変換は，そのまま出力する
+      out.Put(spec, q - pct);
+    }
+    if (n > 0) {
+      out.Put(tmp, std::min<size_t>(n, sizeof(tmp) - 1));
+    }
   }
 
-  std::vector<char> s2(result + 1);
-  va_start(ap, format);
-  vsnprintf(&s2[0], result + 1, format, ap);
   va_end(ap);
-  fd.Write(&s2[0], result);
-  return result;
+  out.Flush();
+  return out.Total();
 }
 
 size_t ReadDelim(FileDescriptor& fd, char delim, char* buf, size_t len) {
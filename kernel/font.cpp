@@ -6,15 +6,22 @@
 
 #include "font.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #include "fat.hpp"
+#include "interrupt.hpp"
 #include "logger.hpp"
+#include "task.hpp"
 
 extern const uint8_t _binary_hankaku_bin_start;
 extern const uint8_t _binary_hankaku_bin_end;
 extern const uint8_t _binary_hankaku_bin_size;
+extern const uint8_t _binary_jisatlas_bin_start;
+extern const uint8_t _binary_jisatlas_bin_size;
 
 namespace {
 
@@ -26,8 +33,98 @@ const uint8_t* GetFont(char c) {
   return &_binary_hankaku_bin_start + index;
 }
 
+/* tools/makeatlas.py が作るグリフアトラスの形式 */
+struct AtlasHeader {
+  char magic[8];
+  uint32_t num_glyphs;
+  uint8_t glyph_size;
+  uint8_t pitch;
+  uint16_t reserved;
+} __attribute__((packed));
+
+struct AtlasGlyph {
+  int8_t left, top;
+  uint8_t width, rows;
+  uint8_t bits[]; // pitch バイト × glyph_size 行
+} __attribute__((packed));
+
+const AtlasHeader* atlas;
+const uint32_t* atlas_codes;   // 昇順に並んだコードポイント
+const uint8_t* atlas_glyphs;
+size_t atlas_glyph_bytes;
+
+void InitializeAtlas() {
+  const size_t size = reinterpret_cast<uintptr_t>(&_binary_jisatlas_bin_size);
+  auto header = reinterpret_cast<const AtlasHeader*>(&_binary_jisatlas_bin_start);
+  if (size < sizeof(AtlasHeader) || memcmp(header->magic, "MKATLAS1", 8) != 0) {
+    Log(kWarn, "no glyph atlas\n");
+    return;
+  }
+  const size_t glyph_bytes = sizeof(AtlasGlyph) + header->pitch * header->glyph_size;
+  if (sizeof(AtlasHeader) + header->num_glyphs * (4 + glyph_bytes) > size) {
+    Log(kError, "broken glyph atlas\n");
+    return;
+  }
+
+  atlas = header;
+  atlas_codes = reinterpret_cast<const uint32_t*>(header + 1);
+  atlas_glyphs = reinterpret_cast<const uint8_t*>(atlas_codes + header->num_glyphs);
+  atlas_glyph_bytes = glyph_bytes;
+  Log(kInfo, "glyph atlas: %u glyphs\n", header->num_glyphs);
+}
+
+const AtlasGlyph* FindAtlasGlyph(char32_t c) {
+  if (!atlas) {
+    return nullptr;
+  }
+  const auto end = atlas_codes + atlas->num_glyphs;
+  const auto it = std::lower_bound(atlas_codes, end, static_cast<uint32_t>(c));
+  if (it == end || *it != c) {
+    return nullptr;
+  }
+  return reinterpret_cast<const AtlasGlyph*>(
+      atlas_glyphs + atlas_glyph_bytes * (it - atlas_codes));
+}
+
 FT_Library ft_library;
 std::vector<uint8_t>* nihongo_buf;
+bool nihongo_load_tried = false;
+FT_Face shared_face; // 最初に使うときに作り，以後はすべての文字で使い回す
+
+// アトラスにない文字を初めて描くときに，FreeType とフォントファイルを準備する
+void LoadNihongoFont() {
+  if (nihongo_load_tried) {
+    return;
+  }
+  nihongo_load_tried = true;
+
+  if (int err = FT_Init_FreeType(&ft_library)) {
+    Log(kError, "failed to initialize FreeType library\n");
+    return;
+  }
+
+  auto [ entry, pos_slash ] = fat::FindFile("/nihongo.ttf");
+  if (entry == nullptr || pos_slash) {
+    Log(kWarn, "no nihongo.ttf\n");
+    return;
+  }
+
+  const size_t size = entry->file_size;
+  auto buf = new std::vector<uint8_t>(size);
+  if (LoadFile(buf->data(), size, *entry) != size) {
+    delete buf;
+    Log(kError, "failed to load nihongo.ttf\n");
+    return;
+  }
+  nihongo_buf = buf;
+}
+
+void DrawGlyphBits(PixelWriter& writer, Vector2D<int> topleft, int width, int rows,
+                   const uint8_t* bits, int pitch, const PixelColor& color) {
+  for (int dy = 0; dy < rows; ++dy) {
+    writer.WriteMaskedSpan(topleft + Vector2D<int>{0, dy}, &bits[pitch * dy], width, color);
+  }
+}
 
 Error RenderUnicode(char32_t c, FT_Face face) {
   const auto glyph_index = FT_Get_Char_Index(face, c);
@@ -42,6 +139,161 @@ Error RenderUnicode(char32_t c, FT_Face face) {
   return MAKE_ERROR(Error::kSuccess);
 }
 
+/** @brief 描画済みの単色グリフ．bits は 1 行 kGlyphPitch バイトで MSB から左のピクセル */
+struct Glyph {
+  static const int kMaxSize = 32;
+  static const int kPitch = kMaxSize / 8;
+
+  char32_t code;
+  bool valid;         // false ならフォントにない文字（"??" で代用する）
+  int8_t left, top;   // 文字の描画位置から見たビットマップの左上
+  uint8_t width, rows;
+  std::array<uint8_t, kPitch * kMaxSize> bits;
+};
+
+/* 4 ウェイのセットアソシアティブキャッシュ．セット内では最も長く使われていない
+ * ものを追い出すので，全体としてはおおよそ LRU になる．
+ * 表の参照と更新は割り込みを禁止して行う．
+ */
+const size_t kGlyphCacheSets = 256;
+const size_t kGlyphCacheWays = 4;
+
+struct GlyphCacheEntry {
+  Glyph glyph;
+  uint64_t last_used; // 0 なら空き
+};
+
+std::array<GlyphCacheEntry, kGlyphCacheSets * kGlyphCacheWays>* glyph_cache;
+uint64_t glyph_cache_clock;
+GlyphCacheStats glyph_cache_stats{0, 0, 0, 0, kGlyphCacheSets * kGlyphCacheWays};
+
+void RenderGlyph(char32_t c, Glyph& glyph) {
+  glyph.code = c;
+  glyph.valid = false;
+  if (!shared_face) {
+    auto [ face, err ] = NewFTFace();
+    if (err) {
+      return;
+    }
+    shared_face = face;
+  }
+  if (RenderUnicode(c, shared_face)) {
+    return;
+  }
+
+  const FT_Bitmap& bitmap = shared_face->glyph->bitmap;
+  const int baseline = (shared_face->height + shared_face->descender) *
+    shared_face->size->metrics.y_ppem / shared_face->units_per_EM;
+  glyph.valid = true;
+  glyph.left = shared_face->glyph->bitmap_left;
+  glyph.top = baseline - shared_face->glyph->bitmap_top;
+  glyph.width = std::min<int>(bitmap.width, Glyph::kMaxSize);
+  glyph.rows = std::min<int>(bitmap.rows, Glyph::kMaxSize);
+
+  const int row_bytes = (glyph.width + 7) / 8;
+  for (int dy = 0; dy < glyph.rows; ++dy) {
+    const unsigned char* q = &bitmap.buffer[bitmap.pitch * dy];
+    if (bitmap.pitch < 0) {
+      q -= bitmap.pitch * bitmap.rows;
+    }
+    memcpy(&glyph.bits[Glyph::kPitch * dy], q, row_bytes);
+  }
+}
+
+/* FreeType の face は共有なので，グリフを描くのは一度に 1 タスクだけにする．
+ * 描画やフォントの読み込みは時間がかかるので割り込みは許可したまま行い，
+ * 順番を待つタスクは眠らせておく．
+ */
+bool renderer_busy;
+std::vector<Task*>* renderer_waiters;
+
+void AcquireRenderer() {
+  InterruptGuard guard;
+  if (!renderer_waiters) {
+    renderer_waiters = new std::vector<Task*>;
+  }
+  while (renderer_busy) {
+    Task* task = &task_manager->CurrentTask();
+    renderer_waiters->push_back(task);
+    task_manager->Sleep(task);
+  }
+  renderer_busy = true;
+}
+
+void ReleaseRenderer() {
+  InterruptGuard guard;
+  renderer_busy = false;
+  for (Task* task : *renderer_waiters) {
+    task_manager->Wakeup(task);
+  }
+  renderer_waiters->clear();
+}
+
+// キャッシュに c があれば out に写して true を返す．割り込み禁止で呼ぶ
+bool FindCachedGlyph(char32_t c, Glyph& out) {
+  if (!glyph_cache) {
+    return false;
+  }
+  GlyphCacheEntry* set = &(*glyph_cache)[(c % kGlyphCacheSets) * kGlyphCacheWays];
+  for (size_t way = 0; way < kGlyphCacheWays; ++way) {
+    auto& e = set[way];
+    if (e.last_used && e.glyph.code == c) {
+      ++glyph_cache_stats.hits;
+      e.last_used = ++glyph_cache_clock;
+      out = e.glyph;
+      return true;
+    }
+  }
+  return false;
+}
+
+// 描いたグリフをキャッシュに登録する．割り込み禁止で呼ぶ
+void InsertGlyph(const Glyph& glyph) {
+  if (!glyph_cache) {
+    glyph_cache = new std::array<GlyphCacheEntry, kGlyphCacheSets * kGlyphCacheWays>{};
+  }
+  GlyphCacheEntry* set = &(*glyph_cache)[(glyph.code % kGlyphCacheSets) * kGlyphCacheWays];
+  GlyphCacheEntry* victim = &set[0];
+  for (size_t way = 0; way < kGlyphCacheWays; ++way) {
+    if (set[way].last_used < victim->last_used) {
+      victim = &set[way];
+    }
+  }
+
+  ++glyph_cache_stats.misses;
+  if (victim->last_used) {
+    ++glyph_cache_stats.evictions;
+  } else {
+    ++glyph_cache_stats.entries;
+  }
+  victim->glyph = glyph;
+  victim->last_used = ++glyph_cache_clock;
+}
+
+// c のグリフを out に写す．キャッシュになければ描いて登録する
+void LookupGlyph(char32_t c, Glyph& out) {
+  {
+    InterruptGuard guard;
+    if (FindCachedGlyph(c, out)) {
+      return;
+    }
+  }
+
+  AcquireRenderer();
+  bool cached;
+  {
+    // 順番を待つ間に，他のタスクが同じ文字を描いたかもしれない
+    InterruptGuard guard;
+    cached = FindCachedGlyph(c, out);
+  }
+  if (!cached) {
+    RenderGlyph(c, out);
+    InterruptGuard guard;
+    InsertGlyph(out);
+  }
+  ReleaseRenderer();
+}
+
 } // namespace
 
 void WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor& color) {
@@ -49,18 +301,46 @@ void WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor
   if (font == nullptr) {
     return;
   }
-  for (int dy = 0; dy < 16; ++dy) {
-    for (int dx = 0; dx < 8; ++dx) {
-      if ((font[dy] << dx) & 0x80u) {
-        writer.Write(pos + Vector2D<int>{dx, dy}, color);
+  writer.WriteGlyphs8(pos, &font, 1, 16, color);
+}
+
+void WriteAsciiString(PixelWriter& writer, Vector2D<int> pos, const char* s, size_t len,
+                      const PixelColor& color) {
+  // グリフへのポインタを集め，行単位でまとめて描く
+  const int kChunk = 128;
+  const uint8_t* glyphs[kChunk];
+  while (len > 0) {
+    int n = 0;
+    for (; n < kChunk && static_cast<size_t>(n) < len; ++n) {
+      glyphs[n] = GetFont(s[n]);
+      if (glyphs[n] == nullptr) {
+        break;
       }
     }
+    writer.WriteGlyphs8(pos, glyphs, n, 16, color);
+    if (static_cast<size_t>(n) < len && n < kChunk) { // フォントにない文字は空白にする
+      ++n;
+    }
+    pos.x += 8 * n;
+    s += n;
+    len -= n;
   }
 }
 
 void WriteString(PixelWriter& writer, Vector2D<int> pos, const char* s, const PixelColor& color) {
   int x = 0;
   while (*s) {
+    size_t ascii = 0;
+    while (s[ascii] && static_cast<uint8_t>(s[ascii]) < 0x80) {
+      ++ascii;
+    }
+    if (ascii > 0) {
+      WriteAsciiString(writer, pos + Vector2D<int>{8 * x, 0}, s, ascii, color);
+      s += ascii;
+      x += ascii;
+      continue;
+    }
+
     const auto [ u32, bytes ] = ConvertUTF8To32(s);
     WriteUnicode(writer, pos + Vector2D<int>{8 * x, 0}, u32, color);
     s += bytes;
@@ -119,6 +399,7 @@ bool IsHankaku(char32_t c) {
 }
 
 WithError<FT_Face> NewFTFace() {
+  LoadNihongoFont();
   if (!nihongo_buf) {
     return { 0, MAKE_ERROR(Error::kNoSuchEntry) };
   }
@@ -141,59 +422,32 @@ Error WriteUnicode(PixelWriter& writer, Vector2D<int> pos,
     return MAKE_ERROR(Error::kSuccess);
   }
 
-  auto [ face, err ] = NewFTFace();
-  if (err) {
-    WriteAscii(writer, pos, '?', color);
-    WriteAscii(writer, pos + Vector2D<int>{8, 0}, '?', color);
-    return err;
+  // 埋め込みのアトラスは読み出し専用なので，排他せずにそのまま描ける
+  if (auto g = FindAtlasGlyph(c)) {
+    DrawGlyphBits(writer, pos + Vector2D<int>{g->left, g->top}, g->width, g->rows,
+                  g->bits, atlas->pitch, color);
+    return MAKE_ERROR(Error::kSuccess);
   }
-  if (auto err = RenderUnicode(c, face)) {
-    FT_Done_Face(face);
+
+  Glyph glyph;
+  LookupGlyph(c, glyph);
+  if (!glyph.valid) {
     WriteAscii(writer, pos, '?', color);
     WriteAscii(writer, pos + Vector2D<int>{8, 0}, '?', color);
-    return err;
-  }
-  FT_Bitmap& bitmap = face->glyph->bitmap;
-
-  const int baseline = (face->height + face->descender) *
-    face->size->metrics.y_ppem / face->units_per_EM;
-  const auto glyph_topleft = pos + Vector2D<int>{
-    face->glyph->bitmap_left, baseline - face->glyph->bitmap_top};
-
-  for (int dy = 0; dy < bitmap.rows; ++dy) {
-    unsigned char* q = &bitmap.buffer[bitmap.pitch * dy];
-    if (bitmap.pitch < 0) {
-      q -= bitmap.pitch * bitmap.rows;
-    }
-    for (int dx = 0; dx < bitmap.width; ++dx) {
-      const bool b = q[dx >> 3] & (0x80 >> (dx & 0x7));
-      if (b) {
-        writer.Write(glyph_topleft + Vector2D<int>{dx, dy}, color);
-      }
-    }
+    return MAKE_ERROR(nihongo_buf ? Error::kFreeTypeError : Error::kNoSuchEntry);
   }
 
-  FT_Done_Face(face);
+  DrawGlyphBits(writer, pos + Vector2D<int>{glyph.left, glyph.top}, glyph.width, glyph.rows,
+                glyph.bits.data(), Glyph::kPitch, color);
   return MAKE_ERROR(Error::kSuccess);
 }
 
 void InitializeFont() {
-  if (int err = FT_Init_FreeType(&ft_library)) {
-    Log(kError, "failed to initialize FreeType library\n");
-    exit(1);
-  }
-
-  auto [ entry, pos_slash ] = fat::FindFile("/nihongo.ttf");
-  if (entry == nullptr || pos_slash) {
-    Log(kWarn, "no nihongo.ttf\n");
-    return;
-  }
+  // nihongo.ttf はアトラスにない文字を描くまで読み込まない
+  InitializeAtlas();
+}
 
-  const size_t size = entry->file_size;
-  nihongo_buf = new std::vector<uint8_t>(size);
-  if (LoadFile(nihongo_buf->data(), size, *entry) != size) {
-    delete nihongo_buf;
-    Log(kError, "failed to load nihongo.ttf");
-    exit(1);
-  }
+GlyphCacheStats GetGlyphCacheStats() {
+  InterruptGuard guard;
+  return glyph_cache_stats;
 }
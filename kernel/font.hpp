@@ -11,6 +11,9 @@
 
 void WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor& color);
 void WriteString(PixelWriter& writer, Vector2D<int> pos, const char* s, const PixelColor& color);
+/** @brief ASCII 文字だけからなる len バイトの文字列を 1 色でまとめて描く */
+void WriteAsciiString(PixelWriter& writer, Vector2D<int> pos, const char* s, size_t len,
+                      const PixelColor& color);
 
 int CountUTF8Size(uint8_t c);
 std::pair<char32_t, int> ConvertUTF8To32(const char* u8);
@@ -19,3 +22,11 @@ WithError<FT_Face> NewFTFace();
 Error WriteUnicode(PixelWriter& writer, Vector2D<int> pos,
                    char32_t c, const PixelColor& color);
 void InitializeFont();
+
+/** @brief FreeType で描いたグリフのキャッシュの統計 */
+struct GlyphCacheStats {
+  uint64_t hits, misses, evictions;
+  size_t entries, capacity;
+};
+
+GlyphCacheStats GetGlyphCacheStats();
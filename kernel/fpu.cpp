@@ -0,0 +1,64 @@
+#include "fpu.hpp"
+
+#include <cstring>
+
+#include "asmfunc.h"
+#include "logger.hpp"
+
+namespace {
+  // XCR0 のビット
+  const uint64_t kXCR0x87 = 1u << 0;
+  const uint64_t kXCR0SSE = 1u << 1;
+  const uint64_t kXCR0AVX = 1u << 2;
+  const uint64_t kXCR0AVX512 = 0b111u << 5; // opmask, ZMM_Hi256, Hi16_ZMM
+
+  const uint64_t kCR4OSXSAVE = 1u << 18;
+}
+
+size_t fpu_area_size = 512;
+int fpu_save_mode = kFPUSaveFXSAVE;
+bool fpu_avx_enabled = false;
+
+void InitializeFPU() {
+  SetCR0(GetCR0() | 2); // CR0.MP: CR0.TS が立っていれば WAIT 命令でも #NM を発生させる
+
+  uint32_t a, b, c, d;
+  CPUID(0, 0, &a, &b, &c, &d);
+  const uint32_t max_leaf = a;
+  CPUID(1, 0, &a, &b, &c, &d);
+  const bool has_xsave = c & (1u << 26);
+  const bool has_avx = c & (1u << 28);
+  if (max_leaf < 0xd || !has_xsave) {
+    Log(kInfo, "XSAVE is not supported: use FXSAVE\n");
+    return;
+  }
+
+  CPUID(0xd, 0, &a, &b, &c, &d);
+  const uint64_t supported = (static_cast<uint64_t>(d) << 32) | a;
+  uint64_t xcr0 = kXCR0x87 | kXCR0SSE;
+  if (has_avx && (supported & kXCR0AVX)) {
+    xcr0 |= kXCR0AVX;
+    if ((supported & kXCR0AVX512) == kXCR0AVX512) {
+      xcr0 |= kXCR0AVX512;
+    }
+  }
+
+  SetCR4(GetCR4() | kCR4OSXSAVE);
+  SetXCR0(xcr0);
+  fpu_avx_enabled = xcr0 & kXCR0AVX;
+
+  CPUID(0xd, 0, &a, &b, &c, &d);
+  fpu_area_size = b; // 現在の XCR0 で必要な大きさ
+  CPUID(0xd, 1, &a, &b, &c, &d);
+  fpu_save_mode = (a & 1) ? kFPUSaveXSAVEOPT : kFPUSaveXSAVE;
+
+  Log(kInfo, "XSAVE enabled: XCR0 %lx, area %lu bytes, xsaveopt %d\n",
+      xcr0, fpu_area_size, fpu_save_mode == kFPUSaveXSAVEOPT);
+}
+
+void InitFPUArea(uint8_t* area) {
+  // XSAVE ヘッダ（512 バイト目から）も 0 にしておけば XRSTOR で初期状態になる
+  memset(area, 0, fpu_area_size);
+  *reinterpret_cast<uint16_t*>(&area[0]) = 0x037f; // x87 FPU の例外をマスクする
+  *reinterpret_cast<uint32_t*>(&area[24]) = 0x1f80; // MXCSR のすべての例外をマスクする
+}
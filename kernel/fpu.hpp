@@ -0,0 +1,30 @@
+/**
+ * @file fpu.hpp
+ *
+ * FPU/SSE/AVX レジスタの状態保存に関するプログラムを集めたファイル．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** @brief タスクごとの FPU 状態保存領域のバイト数．領域は 64 バイト境界に置く． */
+extern size_t fpu_area_size;
+
+/** @brief 状態保存に使う命令（asmfunc.asm の #NM ハンドラが参照する） */
+enum FPUSaveMode {
+  kFPUSaveFXSAVE = 0,
+  kFPUSaveXSAVE = 1,
+  kFPUSaveXSAVEOPT = 2,
+};
+extern "C" int fpu_save_mode;
+
+/** @brief XCR0 で AVX の状態を有効にしていれば true */
+extern bool fpu_avx_enabled;
+
+/** @brief XSAVE が使えれば有効にし，XCR0 と保存領域の大きさを決める． */
+void InitializeFPU();
+
+/** @brief area をタスク開始時の FPU 状態で初期化する． */
+void InitFPUArea(uint8_t* area);
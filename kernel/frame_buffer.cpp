@@ -1,5 +1,9 @@
 #include "frame_buffer.hpp"
 
+#include <cstring>
+
+#include "blit.hpp"
+
 namespace {
   int BytesPerPixel(PixelFormat format) {
     switch (format) {
@@ -25,6 +29,7 @@ namespace {
 }
 
 Error FrameBuffer::Initialize(const FrameBufferConfig& config) {
+  FreeFrames();
   config_ = config;
 
   const auto bytes_per_pixel = BytesPerPixel(config_.pixel_format);
@@ -32,16 +37,40 @@ Error FrameBuffer::Initialize(const FrameBufferConfig& config) {
     return MAKE_ERROR(Error::kUnknownPixelFormat);
   }
 
-  if (config_.frame_buffer) {
-    buffer_.resize(0);
-  } else {
-    buffer_.resize(
-        bytes_per_pixel
-        * config_.horizontal_resolution * config_.vertical_resolution);
-    config_.frame_buffer = buffer_.data();
-    config_.pixels_per_scan_line = config_.horizontal_resolution;
+  if (!config_.frame_buffer) {
+    // 1 つの連続した領域に確保し，各行の先頭を揃えておく
+    config_.pixels_per_scan_line =
+      (config_.horizontal_resolution + kScanLineAlignment - 1)
+      / kScanLineAlignment * kScanLineAlignment;
+    const size_t bytes = bytes_per_pixel
+      * config_.pixels_per_scan_line * config_.vertical_resolution;
+    const size_t num_frames = (bytes + kBytesPerFrame - 1) / kBytesPerFrame;
+    auto [ frames, err ] = memory_manager->Allocate(num_frames);
+    if (err) {
+      return err;
+    }
+    frames_ = frames;
+    num_frames_ = num_frames;
+    config_.frame_buffer = reinterpret_cast<uint8_t*>(frames.Frame());
+    memset(config_.frame_buffer, 0, num_frames * kBytesPerFrame);
+  }
+
+  return ResetWriter();
+}
+
+FrameBuffer::~FrameBuffer() {
+  FreeFrames();
+}
+
+void FrameBuffer::FreeFrames() {
+  if (num_frames_ > 0) {
+    memory_manager->Free(frames_, num_frames_);
+    frames_ = kNullFrame;
+    num_frames_ = 0;
   }
+}
 
+Error FrameBuffer::ResetWriter() {
   switch (config_.pixel_format) {
     case kPixelRGBResv8BitPerColor:
       writer_ = std::make_unique<RGBResv8BitPerColorPixelWriter>(config_);
@@ -77,7 +106,8 @@ Error FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src,
   const uint8_t* src_buf = FrameAddrAt(src_start_pos, src.config_);
 
   for (int y = 0; y < copy_area.size.y; ++y) {
-    memcpy(dst_buf, src_buf, bytes_per_pixel * copy_area.size.x);
+    CopyPixels(reinterpret_cast<uint32_t*>(dst_buf),
+               reinterpret_cast<const uint32_t*>(src_buf), copy_area.size.x);
     dst_buf += BytesPerScanLine(config_);
     src_buf += BytesPerScanLine(src.config_);
   }
@@ -93,7 +123,8 @@ void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
     uint8_t* dst_buf = FrameAddrAt(dst_pos, config_);
     const uint8_t* src_buf = FrameAddrAt(src.pos, config_);
     for (int y = 0; y < src.size.y; ++y) {
-      memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+      CopyPixels(reinterpret_cast<uint32_t*>(dst_buf),
+                 reinterpret_cast<const uint32_t*>(src_buf), src.size.x);
       dst_buf += bytes_per_scan_line;
       src_buf += bytes_per_scan_line;
     }
@@ -110,9 +141,33 @@ void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
     uint8_t* dst_buf = FrameAddrAt(dst_pos + Vector2D<int>{0, src.size.y - 1}, config_);
     const uint8_t* src_buf = FrameAddrAt(src.pos + Vector2D<int>{0, src.size.y - 1}, config_);
     for (int y = 0; y < src.size.y; ++y) {
-      memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+      CopyPixels(reinterpret_cast<uint32_t*>(dst_buf),
+                 reinterpret_cast<const uint32_t*>(src_buf), src.size.x);
       dst_buf -= bytes_per_scan_line;
       src_buf -= bytes_per_scan_line;
     }
   }
 }
+
+uint32_t* FrameBuffer::NativeAt(Vector2D<int> pos) {
+  return reinterpret_cast<uint32_t*>(FrameAddrAt(pos, config_));
+}
+
+const uint32_t* FrameBuffer::NativeAt(Vector2D<int> pos) const {
+  return reinterpret_cast<const uint32_t*>(FrameAddrAt(pos, config_));
+}
+
+uint32_t FrameBuffer::ToNative(const PixelColor& c) const {
+  if (config_.pixel_format == kPixelRGBResv8BitPerColor) {
+    return c.r | (c.g << 8) | (c.b << 16) | 0xff000000u;
+  }
+  return c.b | (c.g << 8) | (c.r << 16) | 0xff000000u;
+}
+
+PixelColor FrameBuffer::FromNative(uint32_t v) const {
+  const uint8_t lo = v & 0xff, mid = (v >> 8) & 0xff, hi = (v >> 16) & 0xff;
+  if (config_.pixel_format == kPixelRGBResv8BitPerColor) {
+    return {lo, mid, hi};
+  }
+  return {hi, mid, lo};
+}
@@ -1,23 +1,53 @@
 #pragma once
 
-#include <vector>
 #include <memory>
 
 #include "frame_buffer_config.hpp"
 #include "graphics.hpp"
 #include "error.hpp"
+#include "memory_manager.hpp"
 
 class FrameBuffer {
  public:
+  /** @brief 自前で確保するバッファの 1 行の長さをこのピクセル数の倍数に揃える */
+  static const int kScanLineAlignment = 16;
+
+  FrameBuffer() = default;
+  ~FrameBuffer();
+  FrameBuffer(const FrameBuffer&) = delete;
+  FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+  /** @brief config.frame_buffer が nullptr なら，バッファを自前で確保する。
+   *
+   * 自前のバッファはページ境界から始まる専用の物理フレームに置き，0 で埋める。
+   * そのためアプリのアドレス空間へそのまま割り当てられ，割り当てた後も
+   * バッファの場所が変わることはない。最後のページの余りにも他のデータは含まれない。
+   */
   Error Initialize(const FrameBufferConfig& config);
+  /** @brief 自前で確保したバッファの先頭フレーム。確保していなければ kNullFrame */
+  FrameID Frames() const { return frames_; }
+  /** @brief 自前で確保したバッファのフレーム数。確保していなければ 0 */
+  size_t NumFrames() const { return num_frames_; }
   Error Copy(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area);
   void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
 
+  /** @brief 指定した位置のピクセルを，このバッファのピクセル形式のまま指すポインタを返す */
+  uint32_t* NativeAt(Vector2D<int> pos);
+  const uint32_t* NativeAt(Vector2D<int> pos) const;
+  /** @brief 色をこのバッファのピクセル形式（アルファ値は 0xff）に変換する */
+  uint32_t ToNative(const PixelColor& c) const;
+  /** @brief このバッファのピクセル形式の値を色に戻す */
+  PixelColor FromNative(uint32_t v) const;
+
   FrameBufferWriter& Writer() { return *writer_; }
   const FrameBufferConfig& Config() const { return config_; }
 
  private:
+  Error ResetWriter();
+  void FreeFrames();
+
   FrameBufferConfig config_{};
-  std::vector<uint8_t> buffer_{};
+  FrameID frames_{kNullFrame};
+  size_t num_frames_{0};
   std::unique_ptr<FrameBufferWriter> writer_{};
 };
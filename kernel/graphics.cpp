@@ -6,26 +6,40 @@
 
 #include "graphics.hpp"
 
-void RGBResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& c) {
-  auto p = PixelAt(pos);
-  p[0] = c.r;
-  p[1] = c.g;
-  p[2] = c.b;
+void PixelWriter::FillSpan(Vector2D<int> pos, int len, const PixelColor& c) {
+  for (int dx = 0; dx < len; ++dx) {
+    Write(pos + Vector2D<int>{dx, 0}, c);
+  }
+}
+
+void PixelWriter::WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len) {
+  for (int dx = 0; dx < len; ++dx) {
+    Write(pos + Vector2D<int>{dx, 0}, colors[dx]);
+  }
+}
+
+void PixelWriter::WriteMaskedSpan(Vector2D<int> pos, const uint8_t* bits, int len,
+                                  const PixelColor& c) {
+  for (int dx = 0; dx < len; ++dx) {
+    if (bits[dx >> 3] & (0x80u >> (dx & 7))) {
+      Write(pos + Vector2D<int>{dx, 0}, c);
+    }
+  }
 }
 
-void BGRResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& c) {
-  auto p = PixelAt(pos);
-  p[0] = c.b;
-  p[1] = c.g;
-  p[2] = c.r;
+void PixelWriter::WriteGlyphs8(Vector2D<int> pos, const uint8_t* const* glyphs, int count,
+                               int rows, const PixelColor& c) {
+  for (int i = 0; i < count; ++i) {
+    for (int dy = 0; dy < rows; ++dy) {
+      WriteMaskedSpan(pos + Vector2D<int>{8 * i, dy}, &glyphs[i][dy], 8, c);
+    }
+  }
 }
 
 void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c) {
-  for (int dx = 0; dx < size.x; ++dx) {
-    writer.Write(pos + Vector2D<int>{dx, 0}, c);
-    writer.Write(pos + Vector2D<int>{dx, size.y - 1}, c);
-  }
+  writer.FillSpan(pos, size.x, c);
+  writer.FillSpan(pos + Vector2D<int>{0, size.y - 1}, size.x, c);
   for (int dy = 1; dy < size.y - 1; ++dy) {
     writer.Write(pos + Vector2D<int>{0, dy}, c);
     writer.Write(pos + Vector2D<int>{size.x - 1, dy}, c);
@@ -35,9 +49,7 @@ void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
 void FillRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c) {
   for (int dy = 0; dy < size.y; ++dy) {
-    for (int dx = 0; dx < size.x; ++dx) {
-      writer.Write(pos + Vector2D<int>{dx, dy}, c);
-    }
+    writer.FillSpan(pos + Vector2D<int>{0, dy}, size.x, c);
   }
 }
 
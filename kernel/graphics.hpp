@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include "blit.hpp"
 #include "frame_buffer_config.hpp"
 
 struct PixelColor {
@@ -92,6 +93,24 @@ class PixelWriter {
   virtual void Write(Vector2D<int> pos, const PixelColor& c) = 0;
   virtual int Width() const = 0;
   virtual int Height() const = 0;
+
+  /* 以下の横方向の連続ピクセル（スパン）に対する操作は，既定では Write を
+   * 1 ピクセルずつ呼ぶ．実際のピクセル形式を知る派生クラスはこれらを
+   * 上書きし，仮想関数の呼び出しをスパンあたり 1 回にする．
+   */
+  /** @brief pos から右へ len ピクセルを色 c で塗る */
+  virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& c);
+  /** @brief pos から右へ len ピクセルに colors の色を順に書く */
+  virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len);
+  /** @brief pos から右へ len ピクセルのうち，bits の対応するビット（各バイトの MSB から）が 1 のものを色 c で塗る */
+  virtual void WriteMaskedSpan(Vector2D<int> pos, const uint8_t* bits, int len,
+                               const PixelColor& c);
+  /** @brief 幅 8 ピクセル・高さ rows の単色グリフ count 個を pos から右へ並べて描く．
+   *
+   * glyphs[i] は i 番目のグリフの rows バイトのビットマップ（MSB が左）．
+   */
+  virtual void WriteGlyphs8(Vector2D<int> pos, const uint8_t* const* glyphs, int count,
+                            int rows, const PixelColor& c);
 };
 
 class FrameBufferWriter : public PixelWriter {
@@ -106,23 +125,112 @@ class FrameBufferWriter : public PixelWriter {
   uint8_t* PixelAt(Vector2D<int> pos) {
     return config_.frame_buffer + 4 * (config_.pixels_per_scan_line * pos.y + pos.x);
   }
+  size_t ScanLinePixels() const { return config_.pixels_per_scan_line; }
+
+  /** @brief スパンを書き込み先の範囲に収める．
+   *
+   * @return 書き込むべきピクセルがなければ false．skip はスパン先頭から捨てたピクセル数
+   */
+  bool ClipSpan(Vector2D<int>& pos, int& len, int& skip) const {
+    if (pos.y < 0 || Height() <= pos.y) {
+      return false;
+    }
+    skip = pos.x < 0 ? -pos.x : 0;
+    pos.x += skip;
+    len = std::min(len - skip, Width() - pos.x);
+    return len > 0;
+  }
 
  private:
   const FrameBufferConfig& config_;
 };
 
-class RGBResv8BitPerColorPixelWriter : public FrameBufferWriter {
+/** @brief ピクセル形式 F に特化した FrameBufferWriter．
+ *
+ * 色の変換をコンパイル時に決め，スパンを 32 ビット単位でまとめて書く．
+ */
+template <PixelFormat F>
+class NativePixelWriter : public FrameBufferWriter {
  public:
   using FrameBufferWriter::FrameBufferWriter;
-  virtual void Write(Vector2D<int> pos, const PixelColor& c) override;
-};
 
-class BGRResv8BitPerColorPixelWriter : public FrameBufferWriter {
- public:
-  using FrameBufferWriter::FrameBufferWriter;
-  virtual void Write(Vector2D<int> pos, const PixelColor& c) override;
+  // 予約バイトはアルファ値として使い，PixelColor で描いたピクセルは不透明 (0xff) とする
+  static constexpr uint32_t ToNative(const PixelColor& c) {
+    if constexpr (F == kPixelRGBResv8BitPerColor) {
+      return c.r | (c.g << 8) | (c.b << 16) | 0xff000000u;
+    } else {
+      return c.b | (c.g << 8) | (c.r << 16) | 0xff000000u;
+    }
+  }
+
+  virtual void Write(Vector2D<int> pos, const PixelColor& c) override {
+    *NativeAt(pos) = ToNative(c);
+  }
+
+  virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& c) override {
+    int skip;
+    if (!ClipSpan(pos, len, skip)) {
+      return;
+    }
+    FillPixels(NativeAt(pos), len, ToNative(c));
+  }
+
+  virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len) override {
+    int skip;
+    if (!ClipSpan(pos, len, skip)) {
+      return;
+    }
+    uint32_t* p = NativeAt(pos);
+    for (int i = 0; i < len; ++i) {
+      p[i] = ToNative(colors[skip + i]);
+    }
+  }
+
+  virtual void WriteMaskedSpan(Vector2D<int> pos, const uint8_t* bits, int len,
+                               const PixelColor& c) override {
+    int skip;
+    if (!ClipSpan(pos, len, skip)) {
+      return;
+    }
+    const uint32_t v = ToNative(c);
+    uint32_t* p = NativeAt(pos);
+    for (int i = 0; i < len; ++i) {
+      const int bit = skip + i;
+      if (bits[bit >> 3] & (0x80u >> (bit & 7))) {
+        p[i] = v;
+      }
+    }
+  }
+
+  virtual void WriteGlyphs8(Vector2D<int> pos, const uint8_t* const* glyphs, int count,
+                            int rows, const PixelColor& c) override {
+    if (pos.y < 0 || Height() < pos.y + rows) {
+      PixelWriter::WriteGlyphs8(pos, glyphs, count, rows, c);
+      return;
+    }
+    const uint32_t v = ToNative(c);
+    const size_t stride = ScanLinePixels();
+    for (int i = 0; i < count; ++i, pos.x += 8) {
+      if (0 <= pos.x && pos.x + 8 <= Width()) {
+        DrawGlyph8(NativeAt(pos), stride, glyphs[i], rows, v);
+      } else {
+        // 左右にはみ出すグリフだけは 1 行ずつ切り取って描く
+        for (int dy = 0; dy < rows; ++dy) {
+          WriteMaskedSpan(pos + Vector2D<int>{0, dy}, &glyphs[i][dy], 8, c);
+        }
+      }
+    }
+  }
+
+ private:
+  uint32_t* NativeAt(Vector2D<int> pos) {
+    return reinterpret_cast<uint32_t*>(PixelAt(pos));
+  }
 };
 
+using RGBResv8BitPerColorPixelWriter = NativePixelWriter<kPixelRGBResv8BitPerColor>;
+using BGRResv8BitPerColorPixelWriter = NativePixelWriter<kPixelBGRResv8BitPerColor>;
+
 void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c);
 
@@ -12,6 +12,7 @@
 #include "segment.hpp"
 #include "timer.hpp"
 #include "task.hpp"
+#include "trace.hpp"
 #include "graphics.hpp"
 #include "font.hpp"
 
@@ -78,7 +79,10 @@ namespace {
   __attribute__((interrupt))
   void IntHandlerPF(InterruptFrame* frame, uint64_t error_code) {
     uint64_t cr2 = GetCR2();
-    if (auto err = HandlePageFault(error_code, cr2); !err) {
+    Trace(TraceEvent::kPageFaultEnter, cr2, error_code);
+    auto err = HandlePageFault(error_code, cr2);
+    Trace(TraceEvent::kPageFaultExit, cr2, err.Cause());
+    if (!err) {
       return;
     }
     KillApp(frame);
@@ -112,7 +116,6 @@ namespace {
   FaultHandlerNoError(OF)
   FaultHandlerNoError(BR)
   FaultHandlerNoError(UD)
-  FaultHandlerNoError(NM)
   FaultHandlerWithError(DF)
   FaultHandlerWithError(TS)
   FaultHandlerWithError(NP)
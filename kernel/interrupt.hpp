@@ -74,4 +74,25 @@ struct InterruptFrame {
 
 void NotifyEndOfInterrupt();
 
+/** @brief 生成から破棄までの間，割り込みを禁止する．
+ *
+ * 破棄するときは生成前の割り込み許可フラグに戻すので，すでに cli した区間の中でも使える．
+ */
+class InterruptGuard {
+ public:
+  InterruptGuard() {
+    __asm__ volatile("pushfq\n\tpop %0\n\tcli" : "=r"(rflags_) :: "memory");
+  }
+  ~InterruptGuard() {
+    if (rflags_ & 0x200) {
+      __asm__ volatile("sti" ::: "memory");
+    }
+  }
+  InterruptGuard(const InterruptGuard&) = delete;
+  InterruptGuard& operator=(const InterruptGuard&) = delete;
+
+ private:
+  uint64_t rflags_;
+};
+
 void InitializeInterrupt();
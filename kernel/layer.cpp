@@ -2,8 +2,11 @@
 
 #include <algorithm>
 #include "console.hpp"
+#include "interrupt.hpp"
 #include "logger.hpp"
 #include "task.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
 
 namespace {
   template <class T, class U>
@@ -11,6 +14,78 @@ namespace {
     auto it = std::remove_if(c.begin(), c.end(), pred);
     c.erase(it, c.end());
   }
+
+  // 損傷領域をまとめるときに，余分に描いてもよい面積
+  const int kMergeSlackPixels = 64 * 64;
+
+  int Area(const Rectangle<int>& r) {
+    return r.size.x * r.size.y;
+  }
+
+  Rectangle<int> BoundingBox(const Rectangle<int>& a, const Rectangle<int>& b) {
+    const auto pos = ElementMin(a.pos, b.pos);
+    const auto end = ElementMax(a.pos + a.size, b.pos + b.size);
+    return {pos, end - pos};
+  }
+
+  // 重なる領域や近くの領域とは，外接矩形にしても無駄に描く面積が
+  // 大きく増えない限りまとめて rects に加える
+  void MergeRect(std::vector<Rectangle<int>>& rects, Rectangle<int> area) {
+    for (bool merged = true; merged;) {
+      merged = false;
+      for (auto it = rects.begin(); it != rects.end(); ++it) {
+        const auto u = BoundingBox(*it, area);
+        if (Area(u) <= Area(*it) + Area(area) + kMergeSlackPixels) {
+          area = u;
+          rects.erase(it);
+          merged = true;
+          break;
+        }
+      }
+    }
+
+    if (rects.size() >= LayerManager::kMaxDamageRects) {
+      for (const auto& r : rects) {
+        area = BoundingBox(area, r);
+      }
+      rects.clear();
+    }
+    rects.push_back(area);
+  }
+
+  bool IsEmpty(const Rectangle<int>& r) {
+    return r.size.x <= 0 || r.size.y <= 0;
+  }
+
+  // 互いに重ならない矩形の集まりで表した領域 region から矩形 r を取り除く
+  void SubtractRect(std::vector<Rectangle<int>>& region, const Rectangle<int>& r) {
+    const auto r_end = r.pos + r.size;
+    for (size_t i = 0; i < region.size();) {
+      const auto a = region[i];
+      const auto is = a & r;
+      if (is.size.x <= 0 || is.size.y <= 0) {
+        ++i;
+        continue;
+      }
+
+      // 重なった部分の上下左右の残りに分割する
+      region[i] = region.back();
+      region.pop_back();
+      const auto a_end = a.pos + a.size;
+      if (a.pos.y < r.pos.y) {
+        region.push_back({a.pos, {a.size.x, r.pos.y - a.pos.y}});
+      }
+      if (r_end.y < a_end.y) {
+        region.push_back({{a.pos.x, r_end.y}, {a.size.x, a_end.y - r_end.y}});
+      }
+      if (a.pos.x < r.pos.x) {
+        region.push_back({{a.pos.x, is.pos.y}, {r.pos.x - a.pos.x, is.size.y}});
+      }
+      if (r_end.x < a_end.x) {
+        region.push_back({{r_end.x, is.pos.y}, {a_end.x - r_end.x, is.size.y}});
+      }
+    }
+  }
 } // namespace
 
 Layer::Layer(unsigned int id) : id_{id} {
@@ -81,53 +156,239 @@ void LayerManager::RemoveLayer(unsigned int id) {
   EraseIf(layers_, pred);
 }
 
-void LayerManager::Draw(const Rectangle<int>& area) const {
-  for (auto layer : layer_stack_) {
-    layer->DrawTo(back_buffer_, area);
-  }
-  screen_->Copy(area.pos, back_buffer_, area);
+void LayerManager::Draw(const Rectangle<int>& area) {
+  AddDamage(area);
 }
 
-void LayerManager::Draw(unsigned int id) const {
+void LayerManager::Draw(unsigned int id) {
   Draw(id, {{0, 0}, {-1, -1}});
 }
 
-void LayerManager::Draw(unsigned int id, Rectangle<int> area) const {
-  bool draw = false;
+void LayerManager::Draw(unsigned int id, Rectangle<int> area) {
   Rectangle<int> window_area;
-  for (auto layer : layer_stack_) {
-    if (layer->ID() == id) {
-      window_area.size = layer->GetWindow()->Size();
-      window_area.pos = layer->GetPosition();
-      if (area.size.x >= 0 || area.size.y >= 0) {
-        area.pos = area.pos + window_area.pos;
-        window_area = window_area & area;
+  {
+    InterruptGuard guard;
+    auto it = std::find_if(layer_stack_.begin(), layer_stack_.end(),
+                           [id](Layer* layer) { return layer->ID() == id; });
+    if (it == layer_stack_.end() || !(*it)->GetWindow()) {
+      return;
+    }
+    window_area.size = (*it)->GetWindow()->Size();
+    window_area.pos = (*it)->GetPosition();
+  }
+  if (area.size.x >= 0 || area.size.y >= 0) {
+    area.pos = area.pos + window_area.pos;
+    window_area = window_area & area;
+  }
+  AddDamage(window_area);
+}
+
+void LayerManager::RequestFrameCallback(void (*f)(void*), void* arg) {
+  {
+    InterruptGuard guard;
+    frame_callbacks_.push_back({f, arg});
+  }
+  RequestFrame();
+}
+
+void LayerManager::Composite() {
+  std::vector<std::pair<void (*)(void*), void*>> callbacks;
+  {
+    InterruptGuard guard;
+    callbacks.swap(frame_callbacks_);
+  }
+  for (const auto& [f, arg] : callbacks) {
+    f(arg);
+  }
+
+  std::vector<Rectangle<int>> damage, copy_only;
+  {
+    InterruptGuard guard;
+    damage.swap(damage_);
+    copy_only.swap(copy_only_);
+    frame_pending_ = false;
+  }
+  // タイマーの初期化前にも呼ばれる
+  const uint64_t now = timer_manager ? CurrentTimeNs() : 0;
+  next_frame_ns_ = now + 1'000'000'000 / refresh_rate_;
+  if (damage.empty() && copy_only.empty()) {
+    return;
+  }
+
+  Trace(TraceEvent::kLayerDrawBegin, damage.size());
+  uint64_t pixels = 0;
+  std::vector<std::vector<Rectangle<int>>> visible(layer_stack_.size());
+  for (const auto& area : damage) {
+    // 上のレイヤーから順に，不透明なレイヤーで隠された部分を取り除いていく
+    std::vector<Rectangle<int>> uncovered{area};
+    for (int h = layer_stack_.size() - 1; h >= 0; --h) {
+      const Layer* layer = layer_stack_[h];
+      visible[h].clear();
+      const auto& window = layer->GetWindow();
+      if (!window || uncovered.empty()) {
+        continue;
+      }
+
+      const Rectangle<int> layer_area{layer->GetPosition(), window->Size()};
+      for (const auto& r : uncovered) {
+        if (const auto is = r & layer_area; is.size.x > 0 && is.size.y > 0) {
+          visible[h].push_back(is);
+        }
+      }
+      if (window->IsOpaque()) {
+        SubtractRect(uncovered, layer_area);
       }
-      draw = true;
     }
-    if (draw) {
-      layer->DrawTo(back_buffer_, window_area);
+
+    // 透過色を持つレイヤーは下のレイヤーの後に描く必要があるので，下から描く
+    for (size_t h = 0; h < layer_stack_.size(); ++h) {
+      for (const auto& r : visible[h]) {
+        layer_stack_[h]->DrawTo(back_buffer_, r);
+      }
     }
+    screen_->Copy(area.pos, back_buffer_, area);
+    pixels += area.size.x * area.size.y;
+  }
+  // ウィンドウの移動で back_buffer_ の中だけずらした部分を画面に転送する
+  for (const auto& area : copy_only) {
+    screen_->Copy(area.pos, back_buffer_, area);
+    pixels += area.size.x * area.size.y;
   }
-  screen_->Copy(window_area.pos, back_buffer_, window_area);
+  Trace(TraceEvent::kLayerDrawEnd, pixels);
+
+  ++stats_.frames;
+  stats_.pixels += pixels;
+  stats_.last_frame_pixels = pixels;
+  if (const uint64_t second = now / 1'000'000'000; second != stats_second_) {
+    stats_.last_second_frames = second == stats_second_ + 1 ? stats_second_frames_ : 0;
+    stats_second_ = second;
+    stats_second_frames_ = 0;
+  }
+  ++stats_second_frames_;
+}
+
+void LayerManager::StartCompositor(uint64_t task_id) {
+  InterruptGuard guard;
+  compositor_task_id_ = task_id;
+  if (!damage_.empty()) {
+    RequestFrame();
+  }
+}
+
+void LayerManager::SetRefreshRate(unsigned int hz) {
+  refresh_rate_ = std::max(1u, hz);
+}
+
+CompositorStats LayerManager::Stats() const {
+  auto stats = stats_;
+  stats.refresh_rate = refresh_rate_;
+  return stats;
+}
+
+Rectangle<int> LayerManager::ScreenArea() const {
+  const auto& config = screen_->Config();
+  return {{0, 0}, {static_cast<int>(config.horizontal_resolution),
+                   static_cast<int>(config.vertical_resolution)}};
+}
+
+void LayerManager::AddDamage(Rectangle<int> area) {
+  area = area & ScreenArea();
+  if (IsEmpty(area)) {
+    return;
+  }
+
+  {
+    InterruptGuard guard;
+    MergeRect(damage_, area);
+  }
+  RequestFrame();
+}
+
+void LayerManager::RequestFrame() {
+  if (compositor_task_id_ == 0) {
+    Composite();
+    return;
+  }
+
+  InterruptGuard guard;
+  if (frame_pending_) {
+    return;
+  }
+  frame_pending_ = true;
+  const uint64_t timeout = std::max(next_frame_ns_, CurrentTimeNs());
+  timer_manager->AddTimerNs(
+      Timer{timeout, kCompositeTimerValue, compositor_task_id_});
 }
 
 void LayerManager::Move(unsigned int id, Vector2D<int> new_pos) {
-  auto layer = FindLayer(id);
-  const auto window_size = layer->GetWindow()->Size();
-  const auto old_pos = layer->GetPosition();
-  layer->Move(new_pos);
-  Draw({old_pos, window_size});
-  Draw(id);
+  MoveLayer(FindLayer(id), new_pos);
 }
 
 void LayerManager::MoveRelative(unsigned int id, Vector2D<int> pos_diff) {
   auto layer = FindLayer(id);
-  const auto window_size = layer->GetWindow()->Size();
-  const auto old_pos = layer->GetPosition();
-  layer->MoveRelative(pos_diff);
-  Draw({old_pos, window_size});
-  Draw(id);
+  MoveLayer(layer, layer->GetPosition() + pos_diff);
+}
+
+void LayerManager::MoveLayer(Layer* layer, Vector2D<int> new_pos) {
+  // 合成の途中で back_buffer_ をずらさないよう，割り込みを禁止する
+  InterruptGuard guard;
+
+  const auto window = layer->GetWindow();
+  const Rectangle<int> old_area{layer->GetPosition(), window->Size()};
+  const Rectangle<int> new_area{new_pos, window->Size()};
+  const auto delta = new_pos - old_area.pos;
+  layer->Move(new_pos);
+
+  const auto it = std::find(layer_stack_.begin(), layer_stack_.end(), layer);
+  if (it == layer_stack_.end()) {
+    return;
+  }
+  if (!window->IsOpaque() || compositor_task_id_ == 0) {
+    AddDamage(old_area);
+    AddDamage(new_area);
+    return;
+  }
+
+  // 合成済みのウィンドウの画素を back_buffer_ の中でずらす
+  const auto screen_area = ScreenArea();
+  auto src = old_area & screen_area;
+  const auto dst = Rectangle<int>{src.pos + delta, src.size} & screen_area;
+  src = {dst.pos - delta, dst.size};
+  std::vector<Rectangle<int>> exposed{new_area};
+  if (!IsEmpty(dst)) {
+    back_buffer_.Move(dst.pos, src);
+    MergeRect(copy_only_, dst);
+    SubtractRect(exposed, dst);
+  }
+
+  // ずらした画素で埋まらなかった部分と，ウィンドウがどいて見えるようになった部分
+  for (const auto& r : exposed) {
+    AddDamage(r);
+  }
+  exposed = {old_area};
+  SubtractRect(exposed, new_area);
+  for (const auto& r : exposed) {
+    AddDamage(r);
+  }
+
+  // まだ合成していない損傷領域は，古い画素ごとずれてしまったので移動先でも描き直す
+  const auto pending = damage_;
+  for (const auto& r : pending) {
+    AddDamage(Rectangle<int>{r.pos + delta, r.size} & new_area);
+  }
+
+  // 上にあるレイヤーの画素も一緒にずれたので描き直す
+  for (auto above = it + 1; above != layer_stack_.end(); ++above) {
+    const auto& above_window = (*above)->GetWindow();
+    if (!above_window) {
+      continue;
+    }
+    const Rectangle<int> above_area{(*above)->GetPosition(), above_window->Size()};
+    AddDamage(above_area & new_area);
+    AddDamage(Rectangle<int>{above_area.pos + delta, above_area.size} & new_area);
+  }
+
+  RequestFrame();
 }
 
 void LayerManager::UpDown(unsigned int id, int new_height) {
@@ -52,9 +52,28 @@ class Layer {
   bool draggable_{false};
 };
 
-/** @brief LayerManager は複数のレイヤーを管理する。 */
+/** @brief 合成の統計情報 */
+struct CompositorStats {
+  uint64_t frames;             // 起動時からの合成回数
+  uint64_t pixels;             // 起動時から画面に転送したピクセル数
+  uint64_t last_frame_pixels;  // 直前の合成で転送したピクセル数
+  unsigned int last_second_frames;  // 直前の 1 秒間の合成回数
+  unsigned int refresh_rate;
+};
+
+/** @brief 合成のタイマーに使う値（メインタスク宛てのタイマー） */
+const int kCompositeTimerValue = 2;
+
+/** @brief LayerManager は複数のレイヤーを管理する。
+ *
+ * Draw メソッドはすぐには描画せず，再描画が必要な領域（損傷領域）を記録する。
+ * 溜まった損傷領域は重なるものをまとめたうえで，フレームごとに 1 回だけ合成して
+ * 画面に転送する。
+ */
 class LayerManager {
  public:
+  static const size_t kMaxDamageRects = 16;
+
   /** @brief Draw メソッドなどで描画する際の描画先を設定する。 */
   void SetWriter(FrameBuffer* screen);
   /** @brief 新しいレイヤーを生成して参照を返す。
@@ -65,12 +84,29 @@ class LayerManager {
   /** @brief 指定されたレイヤーを削除する。 */
   void RemoveLayer(unsigned int id);
 
-  /** @brief 現在表示状態にあるレイヤーを描画する。 */
-  void Draw(const Rectangle<int>& area) const;
-  /** @brief 指定したレイヤーに設定されているウィンドウの描画領域内を再描画する。 */
-  void Draw(unsigned int id) const;
-  /** @brief 指定したレイヤーに設定されているウィンドウ内の指定された範囲を再描画する。 */
-  void Draw(unsigned int id, Rectangle<int> area) const;
+  /** @brief 画面上の指定された範囲の再描画を要求する。 */
+  void Draw(const Rectangle<int>& area);
+  /** @brief 指定したレイヤーに設定されているウィンドウの描画領域内の再描画を要求する。 */
+  void Draw(unsigned int id);
+  /** @brief 指定したレイヤーに設定されているウィンドウ内の指定された範囲の再描画を要求する。 */
+  void Draw(unsigned int id, Rectangle<int> area);
+
+  /** @brief 次の合成の直前に f(arg) を 1 回だけ呼ぶよう予約する。
+   *
+   * 内容の変化が画面の更新より速いウィンドウが，フレームごとに 1 回だけ描くのに使う。
+   * f の中で Draw を呼べば，その領域も同じ合成に含まれる。
+   */
+  void RequestFrameCallback(void (*f)(void*), void* arg);
+  /** @brief 溜まった損傷領域を合成して画面に転送する。 */
+  void Composite();
+  /** @brief 以降の合成を task_id のタスクへのタイマーで行う。
+   *
+   * これを呼ぶまでは，Draw メソッドはその場で合成する。
+   */
+  void StartCompositor(uint64_t task_id);
+  /** @brief 1 秒あたりの最大の合成回数を設定する。 */
+  void SetRefreshRate(unsigned int hz);
+  CompositorStats Stats() const;
 
   /** @brief レイヤーの位置情報を指定された絶対座標へと更新する。再描画する。 */
   void Move(unsigned int id, Vector2D<int> new_pos);
@@ -100,6 +136,22 @@ class LayerManager {
   std::vector<std::unique_ptr<Layer>> layers_{};
   std::vector<Layer*> layer_stack_{};
   unsigned int latest_id_{0};
+
+  std::vector<Rectangle<int>> damage_{};  // 画面座標での損傷領域
+  std::vector<Rectangle<int>> copy_only_{}; // back_buffer_ は最新で，画面への転送だけが必要な領域
+  std::vector<std::pair<void (*)(void*), void*>> frame_callbacks_{};
+  uint64_t compositor_task_id_{0};        // 0 なら合成をその場で行う
+  bool frame_pending_{false};             // 合成のタイマーを予約済み
+  uint64_t next_frame_ns_{0};
+  unsigned int refresh_rate_{60};
+  CompositorStats stats_{};
+  uint64_t stats_second_{0};
+  unsigned int stats_second_frames_{0};
+
+  Rectangle<int> ScreenArea() const;
+  void AddDamage(Rectangle<int> area);
+  void RequestFrame();
+  void MoveLayer(Layer* layer, Vector2D<int> new_pos);
 };
 
 extern LayerManager* layer_manager;
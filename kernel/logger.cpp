@@ -1,12 +1,69 @@
 #include "logger.hpp"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdio>
+#include <cstring>
+#include <vector>
 
 #include "console.hpp"
+#include "file.hpp"
+#include "interrupt.hpp"
+#include "serial.hpp"
+#include "task.hpp"
 
 namespace {
   LogLevel log_level = kWarn;
+
+#ifdef SERIAL_LOG
+  const bool kSerialLog = true;
+#else
+  const bool kSerialLog = false;
+#endif
+
+  // 書式化済みのログを貯めるリングバッファ．古いものから上書きされる
+  const size_t kLogRingBytes = 64 * 1024;
+  char log_ring[kLogRingBytes];
+  uint64_t log_head = 0;     // これまでに書き込んだバイト数
+  uint64_t console_tail = 0; // これまでにコンソールへ表示したバイト数
+  Task* log_task = nullptr;
+
+  // log_ring の pos バイト目から len バイトを buf へ読み出す（呼び出し側で割り込み禁止にする）
+  void CopyFromRing(char* buf, uint64_t pos, size_t len) {
+    const size_t begin = pos % kLogRingBytes;
+    const size_t first = std::min(len, kLogRingBytes - begin);
+    memcpy(buf, &log_ring[begin], first);
+    memcpy(buf + first, &log_ring[0], len - first);
+  }
+
+  void Output(const char* s, size_t len) {
+    console->PutString(s, len);
+    if (kSerialLog) {
+      SerialWrite(s, len);
+    }
+  }
+
+  void TaskLogConsole(uint64_t task_id, int64_t data) {
+    char buf[1024];
+    while (true) {
+      __asm__("cli");
+      if (console_tail == log_head) {
+        log_task->Sleep();
+        __asm__("sti");
+        continue;
+      }
+      if (log_head - console_tail > kLogRingBytes) {
+        // 表示が追いつく前に上書きされた分は飛ばす
+        console_tail = log_head - kLogRingBytes;
+      }
+      const size_t len = std::min<uint64_t>(log_head - console_tail, sizeof(buf));
+      CopyFromRing(buf, console_tail, len);
+      console_tail += len;
+      __asm__("sti");
+
+      Output(buf, len);
+    }
+  }
 }
 
 extern Console* console;
@@ -15,6 +72,62 @@ void SetLogLevel(LogLevel level) {
   log_level = level;
 }
 
+void InitializeLogger() {
+  if (kSerialLog) {
+    InitializeSerial();
+  }
+}
+
+void StartLogTask() {
+  Task& task = task_manager->NewTask()
+    .InitContext(TaskLogConsole, 0);
+
+  // 最低レベルで動かし，他のタスクが暇なときに描く
+  InterruptGuard guard;
+  console_tail = log_head;
+  log_task = &task;
+  task_manager->Wakeup(&task, 0);
+}
+
+void WriteLog(const char* s, size_t len) {
+  bool draw_now = false;
+  {
+    InterruptGuard guard;
+    const size_t n = std::min(len, kLogRingBytes);
+    const char* src = s + (len - n);
+    const size_t begin = log_head % kLogRingBytes;
+    const size_t first = std::min(n, kLogRingBytes - begin);
+    memcpy(&log_ring[begin], src, first);
+    memcpy(&log_ring[0], src + first, n - first);
+    log_head += len;
+
+    if (log_task == nullptr) {
+      // タスクの起動前はその場で描く
+      console_tail = log_head;
+      draw_now = true;
+    } else if (!log_task->Running()) {
+      log_task->Wakeup();
+    }
+  }
+  if (draw_now) {
+    Output(s, len);
+  }
+}
+
+size_t DumpLog(FileDescriptor& fd) {
+  std::vector<char> buf(kLogRingBytes);
+  {
+    InterruptGuard guard;
+    const size_t len = std::min<uint64_t>(log_head, kLogRingBytes);
+    CopyFromRing(buf.data(), log_head - len, len);
+    buf.resize(len);
+  }
+  if (!buf.empty()) {
+    fd.Write(buf.data(), buf.size());
+  }
+  return buf.size();
+}
+
 int Log(LogLevel level, const char* format, ...) {
   if (level > log_level) {
     return 0;
@@ -25,9 +138,9 @@ int Log(LogLevel level, const char* format, ...) {
   char s[1024];
 
   va_start(ap, format);
-  result = vsprintf(s, format, ap);
+  result = vsnprintf(s, sizeof(s), format, ap);
   va_end(ap);
 
-  console->PutString(s);
+  WriteLog(s, std::min<size_t>(result, sizeof(s) - 1));
   return result;
 }
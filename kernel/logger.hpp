@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 enum LogLevel {
   kError = 3,
   kWarn  = 4,
@@ -30,3 +32,28 @@ void SetLogLevel(enum LogLevel level);
  */
 int Log(enum LogLevel level, const char* format, ...)
     __attribute__((format(printf, 2, 3)));
+
+// 以下はカーネル内部でのみ使う（このファイルはアプリからも C 言語として読み込まれる）
+#ifdef __cplusplus
+class FileDescriptor;
+
+/** @brief 書式化済みの文字列をログに追加する．
+ *
+ * ログはリングバッファに溜められ，ログ表示タスクがコンソールへ描く．
+ * 呼び出し側は描画を待たないので，割り込みハンドラからも呼べる．
+ * StartLogTask の前はその場でコンソールに描く．
+ */
+void WriteLog(const char* s, size_t len);
+
+/** @brief ロガーを初期化する．SERIAL_LOG=1 でビルドしたときは COM1 も設定する． */
+void InitializeLogger();
+
+/** @brief リングバッファのログをコンソール（とシリアルポート）へ出力するタスクを起動する． */
+void StartLogTask();
+
+/** @brief リングバッファに残っているログを fd に書き出す．
+ *
+ * @return 書き出したバイト数
+ */
+size_t DumpLog(FileDescriptor& fd);
+#endif
@@ -8,6 +8,7 @@
 #include <cstddef>
 #include <cstdio>
 
+#include <algorithm>
 #include <deque>
 #include <limits>
 #include <numeric>
@@ -24,6 +25,8 @@
 #include "usb/xhci/xhci.hpp"
 #include "interrupt.hpp"
 #include "asmfunc.h"
+#include "fpu.hpp"
+#include "blit.hpp"
 #include "segment.hpp"
 #include "paging.hpp"
 #include "memory_manager.hpp"
@@ -45,10 +48,10 @@ __attribute__((format(printf, 1, 2))) int printk(const char* format, ...) {
   char s[1024];
 
   va_start(ap, format);
-  result = vsprintf(s, format, ap);
+  result = vsnprintf(s, sizeof(s), format, ap);
   va_end(ap);
 
-  console->PutString(s);
+  WriteLog(s, std::min<size_t>(result, sizeof(s) - 1));
   return result;
 }
 
@@ -188,6 +191,7 @@ extern "C" void KernelMainNewStack(
 
   InitializeGraphics(frame_buffer_config_ref);
   InitializeConsole();
+  InitializeLogger();
 
   printk("Welcome to MikanOS!\n");
   SetLogLevel(kWarn);
@@ -209,6 +213,7 @@ extern "C" void KernelMainNewStack(
 
   acpi::Initialize(acpi_table);
   InitializeLAPICTimer();
+  InitializeTimePage();
 
   const int kTextboxCursorTimer = 1;
   const int kTimer05Sec = static_cast<int>(kTimerFreq * 0.5);
@@ -217,8 +222,12 @@ extern "C" void KernelMainNewStack(
 
   InitializeSyscall();
 
+  InitializeFPU();
+  InitializeBlit();
   InitializeTask();
   Task& main_task = task_manager->CurrentTask();
+  layer_manager->StartCompositor(main_task.ID());
+  StartLogTask();
 
   usb::xhci::Initialize();
   InitializeKeyboard();
@@ -234,16 +243,21 @@ extern "C" void KernelMainNewStack(
     .Wakeup();
 
   char str[128];
+  // 合成の直後にカウンタを描き直すと，それがまた次の合成を呼んでしまう
+  bool update_counter = true;
 
   while (true) {
-    __asm__("cli");
-    const auto tick = timer_manager->CurrentTick();
-    __asm__("sti");
+    if (update_counter) {
+      __asm__("cli");
+      const auto tick = timer_manager->CurrentTick();
+      __asm__("sti");
 
-    sprintf(str, "%010lu", tick);
-    FillRectangle(*main_window->InnerWriter(), {20, 4}, {8 * 10, 16}, {0xc6, 0xc6, 0xc6});
-    WriteString(*main_window->InnerWriter(), {20, 4}, str, {0, 0, 0});
-    layer_manager->Draw(main_window_layer_id);
+      sprintf(str, "%010lu", tick);
+      FillRectangle(*main_window->InnerWriter(), {20, 4}, {8 * 10, 16}, {0xc6, 0xc6, 0xc6});
+      WriteString(*main_window->InnerWriter(), {20, 4}, str, {0, 0, 0});
+      layer_manager->Draw(main_window_layer_id);
+    }
+    update_counter = true;
 
     __asm__("cli");
     auto msg = main_task.ReceiveMessage();
@@ -260,7 +274,10 @@ extern "C" void KernelMainNewStack(
       usb::xhci::ProcessEvents();
       break;
     case Message::kTimerTimeout:
-      if (msg->arg.timer.value == kTextboxCursorTimer) {
+      if (msg->arg.timer.value == kCompositeTimerValue) {
+        layer_manager->Composite();
+        update_counter = false;
+      } else if (msg->arg.timer.value == kTextboxCursorTimer) {
         __asm__("cli");
         timer_manager->AddTimer(
             Timer{msg->arg.timer.timeout + kTimer05Sec, kTextboxCursorTimer, 1});
@@ -297,8 +314,9 @@ extern "C" void KernelMainNewStack(
       break;
     case Message::kLayer:
       ProcessLayerMessage(*msg);
+      // 送り手は完了の知らせを待っているので，キューに空きができるまで待ってでも送る
       __asm__("cli");
-      task_manager->SendMessage(msg->src_task, Message{Message::kLayerFinish});
+      task_manager->SendMessageWait(msg->src_task, Message{Message::kLayerFinish});
       __asm__("sti");
       break;
     default:
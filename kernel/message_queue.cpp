@@ -0,0 +1,58 @@
+#include "message_queue.hpp"
+
+#include <algorithm>
+
+#include "interrupt.hpp"
+
+namespace {
+  bool CanCoalesce(const Message& last, const Message& msg) {
+    return last.type == Message::kMouseMove &&
+      msg.type == Message::kMouseMove &&
+      last.src_task == msg.src_task &&
+      last.arg.mouse_move.buttons == msg.arg.mouse_move.buttons;
+  }
+
+  // 溢れたら捨ててよいメッセージ
+  bool IsInput(const Message& msg) {
+    return msg.type == Message::kKeyPush ||
+      msg.type == Message::kMouseMove ||
+      msg.type == Message::kMouseButton;
+  }
+}
+
+bool MessageQueue::Push(const Message& msg) {
+  InterruptGuard guard;
+
+  if (head_ != tail_) {
+    auto& last = buf_[(tail_ - 1) % kCapacity];
+    if (CanCoalesce(last, msg)) {
+      last.arg.mouse_move.x = msg.arg.mouse_move.x;
+      last.arg.mouse_move.y = msg.arg.mouse_move.y;
+      last.arg.mouse_move.dx += msg.arg.mouse_move.dx;
+      last.arg.mouse_move.dy += msg.arg.mouse_move.dy;
+      ++coalesced_;
+      return true;
+    }
+  }
+
+  const size_t limit = IsInput(msg) ? kCapacity - kReservedSlots : kCapacity;
+  if (tail_ - head_ >= limit) {
+    ++dropped_;
+    return false;
+  }
+  buf_[tail_ % kCapacity] = msg;
+  ++tail_;
+  high_water_ = std::max(high_water_, tail_ - head_);
+  return true;
+}
+
+std::optional<Message> MessageQueue::Pop() {
+  InterruptGuard guard;
+
+  if (head_ == tail_) {
+    return std::nullopt;
+  }
+  auto m = buf_[head_ % kCapacity];
+  ++head_;
+  return m;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file message_queue.hpp
+ *
+ * タスクごとのメッセージキュー．
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "message.hpp"
+
+/** @brief 容量が固定のメッセージキュー．
+ *
+ * 割り込みハンドラを含む複数の送り手と 1 つの受け手（タスク自身）が使う．
+ * 送受信ではメモリを確保しない．CPU が 1 つなので，添え字の更新は割り込みを
+ * 禁止した短い区間で行えば排他できる．
+ * 連続する kMouseMove は 1 つにまとめる（dx, dy は合計し，座標は最新のものにする）．
+ * キーやマウスの入力メッセージは kReservedSlots 個の空きを残した状態までしか入れず，
+ * 残りは kLayerFinish や kTimerTimeout などの制御メッセージ用に取っておく．
+ * 入力が溢れても，返事を待っているタスクが制御メッセージを受け取れなくなることはない．
+ * それでも入らなければ Push は false を返して数える．パイプのデータやタイムアウトなど
+ * 失うと困るメッセージの送り手は，捨てずに空きを待つか後で送り直す
+ * （TaskManager::SendMessageWait，TimerManager）．
+ */
+class MessageQueue {
+ public:
+  static const size_t kCapacity = 256;
+  /** @brief 入力メッセージでは使わない，制御メッセージ専用の空き */
+  static const size_t kReservedSlots = 64;
+
+  /** @brief メッセージを末尾に加える．満杯で捨てた場合は false を返す． */
+  bool Push(const Message& msg);
+  std::optional<Message> Pop();
+
+  size_t Size() const { return tail_ - head_; }
+  /** @brief キューに溜まったメッセージ数の最大値 */
+  uint64_t HighWater() const { return high_water_; }
+  /** @brief 満杯のため捨てたメッセージ数 */
+  uint64_t Dropped() const { return dropped_; }
+  /** @brief 直前のメッセージにまとめた kMouseMove の数 */
+  uint64_t Coalesced() const { return coalesced_; }
+
+ private:
+  std::array<Message, kCapacity> buf_;
+  uint64_t head_{0}, tail_{0}; // buf_[head_ % kCapacity] が先頭
+  uint64_t high_water_{0}, dropped_{0}, coalesced_{0};
+};
@@ -97,16 +97,23 @@ namespace {
   }
 }
 
-void DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position) {
-  for (int dy = 0; dy < kMouseCursorHeight; ++dy) {
-    for (int dx = 0; dx < kMouseCursorWidth; ++dx) {
-      if (mouse_cursor_shape[dy][dx] == '@') {
-        pixel_writer->Write(position + Vector2D<int>{dx, dy}, {0, 0, 0});
-      } else if (mouse_cursor_shape[dy][dx] == '.') {
-        pixel_writer->Write(position + Vector2D<int>{dx, dy}, {255, 255, 255});
-      } else {
-        pixel_writer->Write(position + Vector2D<int>{dx, dy}, kMouseTransparentColor);
+void DrawMouseCursor(Window& window, Vector2D<int> position) {
+  auto in_shape = [](int x, int y) {
+    return 0 <= x && x < kMouseCursorWidth && 0 <= y && y < kMouseCursorHeight &&
+      mouse_cursor_shape[y][x] != ' ';
+  };
+
+  const int width = kMouseCursorWidth + kMouseShadowOffset;
+  const int height = kMouseCursorHeight + kMouseShadowOffset;
+  for (int dy = 0; dy < height; ++dy) {
+    for (int dx = 0; dx < width; ++dx) {
+      uint32_t argb = 0; // 完全に透明
+      if (in_shape(dx, dy)) {
+        argb = mouse_cursor_shape[dy][dx] == '@' ? 0xff000000u : 0xffffffffu;
+      } else if (in_shape(dx - kMouseShadowOffset, dy - kMouseShadowOffset)) {
+        argb = 0x60000000u;
       }
+      window.WriteARGB(position + Vector2D<int>{dx, dy}, argb);
     }
   }
 }
@@ -172,9 +179,11 @@ void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x, int8_t displacem
 
 void InitializeMouse() {
   auto mouse_window = std::make_shared<Window>(
-      kMouseCursorWidth, kMouseCursorHeight, screen_config.pixel_format);
-  mouse_window->SetTransparentColor(kMouseTransparentColor);
-  DrawMouseCursor(mouse_window->Writer(), {0, 0});
+      kMouseCursorWidth + kMouseShadowOffset,
+      kMouseCursorHeight + kMouseShadowOffset,
+      screen_config.pixel_format);
+  mouse_window->SetAlphaBlending(true);
+  DrawMouseCursor(*mouse_window, {0, 0});
 
   auto mouse_layer_id = layer_manager->NewLayer()
     .SetWindow(mouse_window)
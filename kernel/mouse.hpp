@@ -9,12 +9,15 @@
 #include <memory>
 
 #include "graphics.hpp"
+#include "window.hpp"
 
 const int kMouseCursorWidth = 15;
 const int kMouseCursorHeight = 24;
-const PixelColor kMouseTransparentColor{0, 0, 1};
+/** @brief カーソルの右下に落とす半透明の影のずれ（ピクセル） */
+const int kMouseShadowOffset = 1;
 
-void DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position);
+/** @brief アルファ合成を有効にしたウィンドウへカーソルと影を描く */
+void DrawMouseCursor(Window& window, Vector2D<int> position);
 
 class Mouse {
  public:
@@ -6,3 +6,5 @@ static constexpr uint32_t kIA32_EFER  = 0xc0000080;
 static constexpr uint32_t kIA32_STAR  = 0xc0000081;
 static constexpr uint32_t kIA32_LSTAR = 0xc0000082;
 static constexpr uint32_t kIA32_FMASK = 0xc0000084;
+
+static constexpr uint32_t kIA32_TSC_DEADLINE = 0x000006e0;
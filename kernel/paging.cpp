@@ -110,7 +110,7 @@ Error CleanPageMap(
       }
     }
 
-    if (entry.bits.writable) {
+    if (entry.bits.writable && !entry.bits.shared) {
       const auto entry_addr = reinterpret_cast<uintptr_t>(entry.Pointer());
       const FrameID map_frame{entry_addr / kBytesPerFrame};
       if (auto err = memory_manager->Free(map_frame, 1)) {
@@ -174,6 +174,18 @@ Error CopyOnePage(uint64_t causal_addr) {
 
 } // namespace
 
+PageMapEntry* FindPageEntry(LinearAddress4Level addr) {
+  auto table = reinterpret_cast<PageMapEntry*>(GetCR3());
+  for (int part = 4; part > 1; --part) {
+    const auto& entry = table[addr.Part(part)];
+    if (!entry.bits.present) {
+      return nullptr;
+    }
+    table = entry.Pointer();
+  }
+  return &table[addr.Part(1)];
+}
+
 WithError<PageMapEntry*> NewPageMap() {
   auto frame = memory_manager->Allocate(1);
   if (frame.error) {
@@ -200,6 +212,37 @@ Error CleanPageMaps(LinearAddress4Level addr) {
   return CleanPageMap(pml4_table, 4, addr);
 }
 
+Error MapSharedPage(LinearAddress4Level addr, uint64_t frame_addr, bool writable) {
+  auto table = reinterpret_cast<PageMapEntry*>(GetCR3());
+  for (int part = 4; part > 1; --part) {
+    auto& entry = table[addr.Part(part)];
+    auto [ child_map, err ] = SetNewPageMapIfNotPresent(entry);
+    if (err) {
+      return err;
+    }
+    entry.bits.user = 1;
+    entry.bits.writable = 1;
+    table = child_map;
+  }
+
+  auto& entry = table[addr.Part(1)];
+  entry.data = 0;
+  entry.SetPointer(reinterpret_cast<PageMapEntry*>(frame_addr));
+  entry.bits.present = 1;
+  entry.bits.writable = writable;
+  entry.bits.user = 1;
+  entry.bits.shared = 1;
+  InvalidateTLB(addr.value);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+void UnmapSharedPage(LinearAddress4Level addr) {
+  if (auto entry = FindPageEntry(addr); entry && entry->bits.shared) {
+    entry->data = 0;
+    InvalidateTLB(addr.value);
+  }
+}
+
 Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start) {
   if (part == 1) {
     for (int i = start; i < 512; ++i) {
@@ -231,10 +274,15 @@ Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start) {
 
 Error HandlePageFault(uint64_t error_code, uint64_t causal_addr) {
   auto& task = task_manager->CurrentTask();
+  task.CountPageFault();
   const bool present = (error_code >> 0) & 1;
   const bool rw      = (error_code >> 1) & 1;
   const bool user    = (error_code >> 2) & 1;
   if (present && rw && user) {
+    if (auto entry = FindPageEntry(LinearAddress4Level{causal_addr});
+        entry && entry->bits.shared) {
+      return MAKE_ERROR(Error::kAlreadyAllocated);
+    }
     return CopyOnePage(causal_addr);
   } else if (present) {
     return MAKE_ERROR(Error::kAlreadyAllocated);
@@ -74,7 +74,8 @@ union PageMapEntry {
     uint64_t dirty : 1;
     uint64_t huge_page : 1;
     uint64_t global : 1;
-    uint64_t : 3;
+    uint64_t shared : 1; // フレームをこのアドレス空間が所有していない（解放もコピーもしない）
+    uint64_t : 2;
 
     uint64_t addr : 40;
     uint64_t : 12;
@@ -94,5 +95,19 @@ Error FreePageMap(PageMapEntry* table);
 Error SetupPageMaps(LinearAddress4Level addr, size_t num_4kpages,
                     bool writable = true);
 Error CleanPageMaps(LinearAddress4Level addr);
+
+/** @brief 既存の物理フレームを addr にユーザー用として割り当てる．
+ *
+ * 割り当てたページには shared ビットを立てるので，CleanPageMaps で解放されず，
+ * 書き込みを試みても copy-on-write されない．writable が false なら読み込み専用にする．
+ */
+Error MapSharedPage(LinearAddress4Level addr, uint64_t frame_addr, bool writable = false);
+/** @brief MapSharedPage で割り当てたページを外す．フレームは解放しない． */
+void UnmapSharedPage(LinearAddress4Level addr);
+/** @brief 現在の CR3 が指す階層ページング構造から addr の 4KiB ページのエントリを探す．
+ *
+ * 途中の階層が存在しなければ nullptr を返す．
+ */
+PageMapEntry* FindPageEntry(LinearAddress4Level addr);
 Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start);
 Error HandlePageFault(uint64_t error_code, uint64_t causal_addr);
@@ -0,0 +1,149 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "paging.hpp"
+#include "timer.hpp"
+
+namespace {
+  const size_t kMaxSamples = 16384;
+  const int kMaxDepth = 16;
+  const uint64_t kUserSpaceBegin = 0xffff'8000'0000'0000;
+
+  struct Sample {
+    uint64_t task_id;
+    uint8_t cpl;
+    uint8_t depth;
+    std::array<uint64_t, kMaxDepth> pcs; // pcs[0] が RIP，以降は戻り先アドレス
+  };
+
+  // CPU が 1 つなので，リングバッファも 1 つだけ持つ
+  std::vector<Sample> samples;
+  size_t num_samples = 0;  // これまでに採取した数（kMaxSamples を超えたら古いものを上書き）
+  bool running = false;
+  uint64_t period_ns;
+  uint64_t next_sample_ns;
+
+  // フレームポインタの指す 16 バイト（前のフレームポインタと戻り先）を読めるか
+  bool IsReadableFrame(uint64_t fp, uint8_t cpl) {
+    if (fp & 7) {
+      return false;
+    }
+    if (cpl == 0) {
+      return 0x1000 <= fp && fp + 16 <= kPageDirectoryCount * (1ul << 30);
+    }
+
+    if (fp < kUserSpaceBegin || fp + 16 < fp) {
+      return false;
+    }
+    // デマンドページングなどでまだ割り当てられていないページには触れない
+    for (uint64_t addr : {fp, fp + 15}) {
+      auto entry = FindPageEntry(LinearAddress4Level{addr});
+      if (!entry || !entry->bits.present || !entry->bits.user) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void TakeSample(const TaskContext& ctx) {
+    auto& s = samples[num_samples % kMaxSamples];
+    ++num_samples;
+
+    s.task_id = task_manager->CurrentTask().ID();
+    s.cpl = ctx.cs & 3;
+    s.pcs[0] = ctx.rip;
+    s.depth = 1;
+
+    // -fno-omit-frame-pointer でビルドされていなければ途中で打ち切られる
+    uint64_t fp = ctx.rbp;
+    while (s.depth < kMaxDepth && IsReadableFrame(fp, s.cpl)) {
+      const auto frame = reinterpret_cast<const uint64_t*>(fp);
+      if (frame[1] == 0) {
+        break;
+      }
+      s.pcs[s.depth++] = frame[1];
+      if (frame[0] <= fp) {
+        break;
+      }
+      fp = frame[0];
+    }
+  }
+
+  bool SameStack(const Sample& a, const Sample& b) {
+    return a.task_id == b.task_id && a.cpl == b.cpl && a.depth == b.depth &&
+      std::equal(a.pcs.begin(), a.pcs.begin() + a.depth, b.pcs.begin());
+  }
+}
+
+void StartProfiler(uint64_t period) {
+  samples.resize(kMaxSamples);
+
+  __asm__("cli");
+  num_samples = 0;
+  period_ns = period;
+  next_sample_ns = CurrentTimeNs() + period_ns;
+  running = true;
+  timer_manager->AddTimerNs(Timer{next_sample_ns, kProfilerTimerValue, 0});
+  __asm__("sti");
+}
+
+size_t StopProfiler() {
+  __asm__("cli");
+  running = false;
+  __asm__("sti");
+  return std::min(num_samples, kMaxSamples);
+}
+
+void ProfilerOnInterrupt(const TaskContext& ctx) {
+  if (!running) {
+    return;
+  }
+  const uint64_t now = CurrentTimeNs();
+  if (now < next_sample_ns) {
+    return;
+  }
+
+  TakeSample(ctx);
+  next_sample_ns = std::max(next_sample_ns + period_ns, now + 1);
+  timer_manager->AddTimerNs(Timer{next_sample_ns, kProfilerTimerValue, 0});
+}
+
+size_t WriteProfile(FileDescriptor& fd) {
+  if (running) {
+    return 0;
+  }
+
+  // 同じスタックのサンプルを隣接させてから数える
+  const size_t n = std::min(num_samples, kMaxSamples);
+  std::vector<const Sample*> sorted(n);
+  for (size_t i = 0; i < n; ++i) {
+    sorted[i] = &samples[i];
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const Sample* a, const Sample* b) {
+    if (a->task_id != b->task_id) return a->task_id < b->task_id;
+    if (a->cpl != b->cpl) return a->cpl < b->cpl;
+    return std::lexicographical_compare(a->pcs.begin(), a->pcs.begin() + a->depth,
+                                        b->pcs.begin(), b->pcs.begin() + b->depth);
+  });
+
+  size_t lines = 0;
+  for (size_t i = 0; i < n;) {
+    const Sample& s = *sorted[i];
+    size_t count = 1;
+    while (i + count < n && SameStack(s, *sorted[i + count])) {
+      ++count;
+    }
+    i += count;
+
+    PrintToFD(fd, "%lu;%u", s.task_id, s.cpl);
+    for (int d = s.depth - 1; d >= 0; --d) {
+      PrintToFD(fd, ";%lx", s.pcs[d]);
+    }
+    PrintToFD(fd, " %lu\n", count);
+    ++lines;
+  }
+  return lines;
+}
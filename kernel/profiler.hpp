@@ -0,0 +1,36 @@
+/**
+ * @file profiler.hpp
+ *
+ * タイマー割り込みで割り込まれた場所とコールスタックを採取する統計的プロファイラ．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "file.hpp"
+#include "task.hpp"
+
+/** @brief サンプルの採取を始める．以前のサンプルは捨てる．
+ *
+ * @param period_ns  採取の間隔．TSC-deadline モードでなければ tick の間隔に丸められる
+ */
+void StartProfiler(uint64_t period_ns);
+
+/** @brief サンプルの採取をやめ，採取できたサンプル数を返す． */
+size_t StopProfiler();
+
+/** @brief プロファイラが動いていて採取の時刻なら，割り込まれた文脈を記録する．
+ *
+ * タイマー割り込みハンドラから呼ぶ．
+ */
+void ProfilerOnInterrupt(const TaskContext& ctx);
+
+/** @brief 採取したサンプルを folded stacks 形式で fd に書き出し，行数を返す．
+ *
+ * 各行は "<タスク ID>;<CPL>;<最も外側のアドレス>;...;<RIP> <回数>" の形式．
+ * アドレスは 16 進数のままなので，ホスト側で kernel.elf やアプリの ELF を使って
+ * シンボルに変換する（tools/symbolize_profile.py）．
+ */
+size_t WriteProfile(FileDescriptor& fd);
@@ -0,0 +1,57 @@
+#include "serial.hpp"
+
+#include "asmfunc.h"
+
+namespace {
+  const uint16_t kCOM1 = 0x3f8;
+
+  // UART 16550 のレジスタ（kCOM1 からのオフセット）
+  const uint16_t kData = 0;           // DLAB = 1 のときは除数の下位
+  const uint16_t kInterruptEnable = 1; // DLAB = 1 のときは除数の上位
+  const uint16_t kFIFOControl = 2;
+  const uint16_t kLineControl = 3;
+  const uint16_t kModemControl = 4;
+  const uint16_t kLineStatus = 5;
+
+  const uint8_t kLineStatusTHRE = 1u << 5; // 送信保持レジスタが空
+
+  bool serial_available = false;
+
+  void PutByte(uint8_t c) {
+    while ((IoIn8(kCOM1 + kLineStatus) & kLineStatusTHRE) == 0);
+    IoOut8(kCOM1 + kData, c);
+  }
+}
+
+bool InitializeSerial() {
+  IoOut8(kCOM1 + kInterruptEnable, 0x00); // 割り込みは使わない
+  IoOut8(kCOM1 + kLineControl, 0x80);     // DLAB = 1
+  IoOut8(kCOM1 + kData, 1);               // 115200 / 1 = 115200bps
+  IoOut8(kCOM1 + kInterruptEnable, 0);
+  IoOut8(kCOM1 + kLineControl, 0x03);     // 8N1, DLAB = 0
+  IoOut8(kCOM1 + kFIFOControl, 0xc7);     // FIFO 有効，クリア，しきい値 14 バイト
+
+  // ループバックモードで送った値が読めるか確かめる
+  IoOut8(kCOM1 + kModemControl, 0x1e);
+  IoOut8(kCOM1 + kData, 0xae);
+  if (IoIn8(kCOM1 + kData) != 0xae) {
+    serial_available = false;
+    return false;
+  }
+
+  IoOut8(kCOM1 + kModemControl, 0x0f);    // 通常モード，DTR/RTS/OUT1/OUT2
+  serial_available = true;
+  return true;
+}
+
+void SerialWrite(const char* s, size_t len) {
+  if (!serial_available) {
+    return;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if (s[i] == '\n') {
+      PutByte('\r');
+    }
+    PutByte(s[i]);
+  }
+}
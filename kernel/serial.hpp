@@ -0,0 +1,18 @@
+/**
+ * @file serial.hpp
+ *
+ * シリアルポート（COM1）への出力．画面のない環境でログを読むのに使う．
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/** @brief COM1 を 115200bps, 8N1 に設定する．
+ *
+ * @return UART が応答すれば true．応答しなければ以降の SerialWrite は何もしない．
+ */
+bool InitializeSerial();
+
+/** @brief COM1 に文字列を送る．改行は CR LF に変換する． */
+void SerialWrite(const char* s, size_t len);
@@ -1,5 +1,6 @@
 #include "syscall.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <cerrno>
@@ -15,6 +16,7 @@
 #include "timer.hpp"
 #include "keyboard.hpp"
 #include "app_event.hpp"
+#include "app_draw.hpp"
 
 namespace syscall {
   struct Result {
@@ -143,53 +145,310 @@ SYSCALL(WinRedraw) {
       }, arg1);
 }
 
+namespace {
+  // 始点と終点を含む線分を描き，描いた範囲を返す
+  Rectangle<int> DrawLine(PixelWriter& writer,
+                          int x0, int y0, int x1, int y1, const PixelColor& c) {
+    const Rectangle<int> area{
+      {std::min(x0, x1), std::min(y0, y1)},
+      {abs(x1 - x0) + 1, abs(y1 - y0) + 1}
+    };
+
+    auto sign = [](int x) {
+      return (x > 0) ? 1 : (x < 0) ? -1 : 0;
+    };
+    const int dx = x1 - x0 + sign(x1 - x0);
+    const int dy = y1 - y0 + sign(y1 - y0);
+
+    if (dx == 0 && dy == 0) {
+      writer.Write({x0, y0}, c);
+      return area;
+    }
+
+    const auto floord = static_cast<double(*)(double)>(floor);
+    const auto ceild = static_cast<double(*)(double)>(ceil);
+
+    if (abs(dx) >= abs(dy)) {
+      if (dx < 0) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+      }
+      const auto roundish = y1 >= y0 ? floord : ceild;
+      const double m = static_cast<double>(dy) / dx;
+      // ウィンドウの外にはみ出す部分は計算もしない
+      const int x_end = std::min(x1, writer.Width() - 1);
+      for (int x = std::max(x0, 0); x <= x_end; ++x) {
+        const int y = roundish(m * (x - x0) + y0);
+        writer.Write({x, y}, c);
+      }
+    } else {
+      if (dy < 0) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+      }
+      const auto roundish = x1 >= x0 ? floord : ceild;
+      const double m = static_cast<double>(dx) / dy;
+      const int y_end = std::min(y1, writer.Height() - 1);
+      for (int y = std::max(y0, 0); y <= y_end; ++y) {
+        const int x = roundish(m * (y - y0) + x0);
+        writer.Write({x, y}, c);
+      }
+    }
+    return area;
+  }
+}
+
 SYSCALL(WinDrawLine) {
   return DoWinFunc(
       [](Window& win,
          int x0, int y0, int x1, int y1, uint32_t color) {
-        auto sign = [](int x) {
-          return (x > 0) ? 1 : (x < 0) ? -1 : 0;
-        };
-        const int dx = x1 - x0 + sign(x1 - x0);
-        const int dy = y1 - y0 + sign(y1 - y0);
-
-        if (dx == 0 && dy == 0) {
-          win.Writer()->Write({x0, y0}, ToColor(color));
-          return Result{ 0, 0 };
-        }
+        DrawLine(*win.Writer(), x0, y0, x1, y1, ToColor(color));
+        return Result{ 0, 0 };
+      }, arg1, arg2, arg3, arg4, arg5, arg6);
+}
 
-        const auto floord = static_cast<double(*)(double)>(floor);
-        const auto ceild = static_cast<double(*)(double)>(ceil);
+namespace {
+  // 座標や大きさがこれを超える命令は受け付けない（範囲の計算が溢れないように）
+  const int kDrawCoordMax = 1 << 16;
 
-        if (abs(dx) >= abs(dy)) {
-          if (dx < 0) {
-            std::swap(x0, x1);
-            std::swap(y0, y1);
-          }
-          const auto roundish = y1 >= y0 ? floord : ceild;
-          const double m = static_cast<double>(dy) / dx;
-          for (int x = x0; x <= x1; ++x) {
-            const int y = roundish(m * (x - x0) + y0);
-            win.Writer()->Write({x, y}, ToColor(color));
-          }
-        } else {
-          if (dy < 0) {
-            std::swap(x0, x1);
-            std::swap(y0, y1);
-          }
-          const auto roundish = x1 >= x0 ? floord : ceild;
-          const double m = static_cast<double>(dx) / dy;
-          for (int y = y0; y <= y1; ++y) {
-            const int x = roundish(m * (y - y0) + x0);
-            win.Writer()->Write({x, y}, ToColor(color));
+  // 1 回の DRAW_OP_BLIT で転送できる最大のピクセル数
+  const int64_t kBlitPixelsMax = 4096 * 4096;
+  const uint64_t kUserSpaceBegin = 0xffff'8000'0000'0000;
+
+  bool InDrawRange(int v) {
+    return -kDrawCoordMax <= v && v <= kDrawCoordMax;
+  }
+
+  // [addr, addr + bytes) がアプリの空間に収まり，末尾が溢れなければ true
+  bool InUserSpace(const void* p, uint64_t bytes) {
+    const uint64_t addr = reinterpret_cast<uint64_t>(p);
+    return addr >= kUserSpaceBegin && bytes <= 0 - addr;
+  }
+
+  bool ValidDrawOp(const DrawOp& op) {
+    if (!InDrawRange(op.x0) || !InDrawRange(op.y0) ||
+        !InDrawRange(op.x1) || !InDrawRange(op.y1)) {
+      return false;
+    }
+    switch (op.type) {
+    case DRAW_OP_FILL_RECT:
+      return op.x1 >= 0 && op.y1 >= 0;
+    case DRAW_OP_LINE:
+      return true;
+    case DRAW_OP_STRING: {
+      if (!InUserSpace(op.data, 1)) {
+        return false;
+      }
+      const size_t max_len =
+        std::min<uint64_t>(1024, 0 - reinterpret_cast<uint64_t>(op.data));
+      return strnlen(reinterpret_cast<const char*>(op.data), max_len) < max_len;
+    }
+    case DRAW_OP_BLIT: {
+      if (op.x1 < 0 || op.y1 < 0) {
+        return false;
+      }
+      const int64_t pixels = static_cast<int64_t>(op.x1) * op.y1;
+      return pixels <= kBlitPixelsMax && InUserSpace(op.data, 4 * pixels);
+    }
+    }
+    return false;
+  }
+
+  // 1 つの命令を描き，描いた範囲を返す
+  Rectangle<int> ExecuteDrawOp(PixelWriter& writer, const DrawOp& op) {
+    switch (op.type) {
+    case DRAW_OP_FILL_RECT:
+      FillRectangle(writer, {op.x0, op.y0}, {op.x1, op.y1}, ToColor(op.color));
+      return {{op.x0, op.y0}, {op.x1, op.y1}};
+    case DRAW_OP_LINE:
+      return DrawLine(writer, op.x0, op.y0, op.x1, op.y1, ToColor(op.color));
+    case DRAW_OP_STRING: {
+      const auto s = reinterpret_cast<const char*>(op.data);
+      WriteString(writer, {op.x0, op.y0}, s, ToColor(op.color));
+      // 全角文字は 3 バイトで幅 16 なので，バイト数 × 8 で必ず覆える
+      return {{op.x0, op.y0}, {8 * static_cast<int>(strlen(s)), 16}};
+    }
+    case DRAW_OP_BLIT: {
+      const auto pixels = reinterpret_cast<const uint32_t*>(op.data);
+      PixelColor buf[256];
+      for (int y = 0; y < op.y1; ++y) {
+        const uint32_t* row = pixels + static_cast<size_t>(op.x1) * y;
+        for (int x = 0; x < op.x1; x += std::size(buf)) {
+          const int n = std::min<int>(op.x1 - x, std::size(buf));
+          for (int i = 0; i < n; ++i) {
+            buf[i] = ToColor(row[x + i]);
           }
+          writer.WriteSpan({op.x0 + x, op.y0 + y}, buf, n);
         }
+      }
+      return {{op.x0, op.y0}, {op.x1, op.y1}};
+    }
+    }
+    return {{0, 0}, {0, 0}};
+  }
+}
+
+SYSCALL(WinDrawBatch) {
+  const uint32_t layer_flags = arg1 >> 32;
+  const unsigned int layer_id = arg1 & 0xffffffff;
+  const auto ops = reinterpret_cast<const DrawOp*>(arg2);
+  const size_t count = arg3;
+  if (count > DRAW_BATCH_MAX) {
+    return { 0, E2BIG };
+  }
+  if (!InUserSpace(ops, count * sizeof(DrawOp))) {
+    return { 0, EFAULT };
+  }
+
+  // 途中まで描いてから失敗することがないよう，先にすべて検証する
+  for (size_t i = 0; i < count; ++i) {
+    if (!ValidDrawOp(ops[i])) {
+      return { i, EINVAL };
+    }
+  }
+
+  __asm__("cli");
+  auto layer = layer_manager->FindLayer(layer_id);
+  __asm__("sti");
+  if (layer == nullptr) {
+    return { 0, EBADF };
+  }
+
+  Window& win = *layer->GetWindow();
+  Vector2D<int> touched_begin{kDrawCoordMax, kDrawCoordMax}, touched_end{0, 0};
+  for (size_t i = 0; i < count; ++i) {
+    const auto area = ExecuteDrawOp(*win.Writer(), ops[i]);
+    if (area.size.x > 0 && area.size.y > 0) {
+      touched_begin = ElementMin(touched_begin, area.pos);
+      touched_end = ElementMax(touched_end, area.pos + area.size);
+    }
+  }
+
+  // 描いた範囲をまとめて 1 回だけ再描画する
+  if ((layer_flags & 1) == 0 &&
+      touched_begin.x < touched_end.x && touched_begin.y < touched_end.y) {
+    const Rectangle<int> touched{touched_begin, touched_end - touched_begin};
+    const auto area = touched & Rectangle<int>{{0, 0}, win.Size()};
+    __asm__("cli");
+    layer_manager->Draw(layer_id, area);
+    __asm__("sti");
+  }
+  return { count, 0 };
+}
+
+SYSCALL(WinMapSurface) {
+  const unsigned int layer_id = arg1 & 0xffffffff;
+  auto surface = reinterpret_cast<WindowSurface*>(arg2);
+  if (!InUserSpace(surface, sizeof(WindowSurface))) {
+    return { 0, EFAULT };
+  }
+
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  auto layer = layer_manager->FindLayer(layer_id);
+  const auto owner = layer_task_map->find(layer_id);
+  const bool owned = owner != layer_task_map->end() && owner->second == task.ID();
+  __asm__("sti");
+  // 他のタスクのウィンドウは割り当てない
+  if (layer == nullptr || !owned) {
+    return { 0, EBADF };
+  }
+
+  Window& win = *layer->GetWindow();
+  auto& maps = task.SurfaceMaps();
+  auto it = std::find_if(maps.begin(), maps.end(),
+                         [layer_id](const auto& m) { return m.layer_id == layer_id; });
+  uint64_t vaddr_begin;
+  if (it != maps.end()) {
+    vaddr_begin = it->vaddr_begin;
+  } else {
+    // 影バッファは最初から専用のフレームにあり，割り当てた後も動かない
+    const auto& buffer = win.ShadowBuffer();
+    if (buffer.NumFrames() == 0) {
+      return { 0, ENOMEM };
+    }
+    const uint64_t frame_addr = reinterpret_cast<uint64_t>(buffer.Frames().Frame());
+    const uint64_t vaddr_end = task.FileMapEnd();
+    vaddr_begin = vaddr_end - buffer.NumFrames() * kBytesPerFrame;
+    for (size_t i = 0; i < buffer.NumFrames(); ++i) {
+      if (auto err = MapSharedPage(LinearAddress4Level{vaddr_begin + i * kBytesPerFrame},
+                                   frame_addr + i * kBytesPerFrame, true)) {
+        // 途中まで割り当てたページを外し，後のファイルの割り当てと重ならないようにする
+        for (size_t j = 0; j < i; ++j) {
+          UnmapSharedPage(LinearAddress4Level{vaddr_begin + j * kBytesPerFrame});
+        }
+        return { 0, ENOMEM };
+      }
+    }
+    task.SetFileMapEnd(vaddr_begin);
+    maps.push_back(SurfaceMapping{layer_id, vaddr_begin, vaddr_end});
+  }
+
+  const auto& config = win.ShadowBuffer().Config();
+  surface->pixels = reinterpret_cast<uint32_t*>(vaddr_begin);
+  surface->stride = config.pixels_per_scan_line;
+  surface->width = win.Width();
+  surface->height = win.Height();
+  surface->format = config.pixel_format == kPixelRGBResv8BitPerColor
+    ? SURFACE_FORMAT_RGB : SURFACE_FORMAT_BGR;
+  return { vaddr_begin, 0 };
+}
+
+SYSCALL(WinCommit) {
+  const unsigned int layer_id = arg1 & 0xffffffff;
+  const Rectangle<int> damage{{static_cast<int>(arg2), static_cast<int>(arg3)},
+                              {static_cast<int>(arg4), static_cast<int>(arg5)}};
+
+  __asm__("cli");
+  auto layer = layer_manager->FindLayer(layer_id);
+  __asm__("sti");
+  if (layer == nullptr) {
+    return { 0, EBADF };
+  }
+  if (damage.size.x < 0 || damage.size.y < 0) {
+    return { 0, EINVAL };
+  }
+
+  Window& win = *layer->GetWindow();
+  const auto area = damage & Rectangle<int>{{0, 0}, win.Size()};
+  if (area.size.x <= 0 || area.size.y <= 0) {
+    return { 0, 0 };
+  }
+  win.Commit(area);
+  __asm__("cli");
+  layer_manager->Draw(layer_id, area);
+  __asm__("sti");
+  return { 0, 0 };
+}
+
+SYSCALL(WinSetAlphaBlending) {
+  const bool enable = arg2 != 0;
+  return DoWinFunc(
+      [enable](Window& win) {
+        win.SetAlphaBlending(enable);
         return Result{ 0, 0 };
-      }, arg1, arg2, arg3, arg4, arg5, arg6);
+      }, arg1);
 }
 
 SYSCALL(CloseWindow) {
   const unsigned int layer_id = arg1 & 0xffffffff;
+
+  // 影バッファはウィンドウと一緒に解放されるので，先にアプリから外す
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  __asm__("sti");
+  auto& maps = task.SurfaceMaps();
+  for (auto it = maps.begin(); it != maps.end();) {
+    if (it->layer_id != layer_id) {
+      ++it;
+      continue;
+    }
+    for (uint64_t addr = it->vaddr_begin; addr < it->vaddr_end; addr += kBytesPerFrame) {
+      UnmapSharedPage(LinearAddress4Level{addr});
+    }
+    it = maps.erase(it);
+  }
+
   const auto err = CloseLayer(layer_id);
   if (err.Cause() == Error::kNoSuchEntry) {
     return { EBADF, 0 };
@@ -285,6 +544,18 @@ SYSCALL(CreateTimer) {
   const uint64_t task_id = task_manager->CurrentTask().ID();
   __asm__("sti");
 
+  if (mode & 2) { // timeout をナノ秒で指定
+    unsigned long timeout = arg3;
+    if (mode & 1) { // relative
+      timeout += CurrentTimeNs();
+    }
+
+    __asm__("cli");
+    timer_manager->AddTimerNs(Timer{timeout, -timer_value, task_id});
+    __asm__("sti");
+    return { timeout, 0 };
+  }
+
   unsigned long timeout = arg3 * kTimerFreq / 1000;
   if (mode & 1) { // relative
     timeout += timer_manager->CurrentTick();
@@ -395,6 +666,10 @@ SYSCALL(MapFile) {
   return { vaddr_begin, 0 };
 }
 
+SYSCALL(GetCurrentTimeNs) {
+  return { CurrentTimeNs(), 0 };
+}
+
 SYSCALL(IsTerminal) {
   const int fd = arg1;
   __asm__("cli");
@@ -408,13 +683,70 @@ SYSCALL(IsTerminal) {
   return { task.Files()[fd]->IsTerminal(), 0 };
 }
 
+SYSCALL(SetDeadline) {
+  const uint64_t runtime_ns = arg1;
+  const uint64_t period_ns = arg2;
+  const uint64_t deadline_ns = arg3 == 0 ? period_ns : arg3;
+  if (runtime_ns != 0 &&
+      (runtime_ns > deadline_ns || deadline_ns > period_ns ||
+       period_ns > 10'000'000'000ul)) {
+    return { 0, EINVAL };
+  }
+
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  const uint64_t misses = task.DeadlineMisses();
+  const auto err = task_manager->SetDeadline(
+      task.ID(), runtime_ns, period_ns, deadline_ns);
+  __asm__("sti");
+
+  if (err.Cause() == Error::kBandwidthExceeded) {
+    return { misses, EBUSY };
+  } else if (err) {
+    return { misses, EINVAL };
+  }
+  return { misses, 0 };
+}
+
+SYSCALL(GetTaskStats) {
+  // 一度に返すタスク数の上限（範囲の計算が溢れないように）
+  const size_t kMaxTaskStats = 1024;
+  const int mode = arg1;
+  auto stats = reinterpret_cast<TaskStats*>(arg2);
+  const size_t count = std::min<size_t>(arg3, kMaxTaskStats);
+  if (count == 0) {
+    return { 0, EINVAL };
+  }
+  if (!InUserSpace(stats, count * sizeof(TaskStats))) {
+    return { 0, EFAULT };
+  }
+
+  if (mode == TASK_STATS_SELF) {
+    __asm__("cli");
+    task_manager->SetUserMode(false); // ここまでの実行時間を計上する
+    const auto self = task_manager->CurrentTask().Stats();
+    __asm__("sti");
+    *stats = self;
+    return { 1, 0 };
+  } else if (mode == TASK_STATS_ALL) {
+    // アプリのメモリへは割り込みを許可してから書き込む（ページフォルトが起こりうる）
+    std::vector<TaskStats> buf(count);
+    __asm__("cli");
+    const size_t n = task_manager->GetTaskStats(buf.data(), count);
+    __asm__("sti");
+    std::copy_n(buf.begin(), n, stats);
+    return { n, 0 };
+  }
+  return { 0, EINVAL };
+}
+
 #undef SYSCALL
 
 } // namespace syscall
 
 using SyscallFuncType = syscall::Result (uint64_t, uint64_t, uint64_t,
                                          uint64_t, uint64_t, uint64_t);
-extern "C" std::array<SyscallFuncType*, 0x11> syscall_table{
+extern "C" std::array<SyscallFuncType*, 0x18> syscall_table{
   /* 0x00 */ syscall::LogString,
   /* 0x01 */ syscall::PutString,
   /* 0x02 */ syscall::Exit,
@@ -432,6 +764,13 @@ extern "C" std::array<SyscallFuncType*, 0x11> syscall_table{
   /* 0x0e */ syscall::DemandPages,
   /* 0x0f */ syscall::MapFile,
   /* 0x10 */ syscall::IsTerminal,
+  /* 0x11 */ syscall::GetCurrentTimeNs,
+  /* 0x12 */ syscall::SetDeadline,
+  /* 0x13 */ syscall::GetTaskStats,
+  /* 0x14 */ syscall::WinDrawBatch,
+  /* 0x15 */ syscall::WinMapSurface,
+  /* 0x16 */ syscall::WinCommit,
+  /* 0x17 */ syscall::WinSetAlphaBlending,
 };
 
 void InitializeSyscall() {
@@ -1,8 +1,14 @@
 #include "task.hpp"
 
+#include <algorithm>
+#include <limits>
+
 #include "asmfunc.h"
+#include "fpu.hpp"
+#include "interrupt.hpp"
 #include "segment.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
 
 namespace {
   template <class T, class U>
@@ -14,9 +20,45 @@ namespace {
   void TaskIdle(uint64_t task_id, int64_t data) {
     while (true) __asm__("hlt");
   }
+
+  // nice 値 -20 〜 19 に対応する重み（nice が 1 増えると CPU 時間が約 10% 減る）
+  const std::array<uint32_t, 40> kNiceToWeight{
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+  };
+  const uint64_t kNice0Weight = 1024;
+
+  // 起床したタスクの vruntime が実行中のタスクよりこれ以上小さければ横取りする
+  const uint64_t kWakeupGranularityNs = 1'000'000;
+  // 眠っていたタスクを min_vruntime からこれだけ手前に置き，応答性を上げる
+  const uint64_t kSleeperCreditNs = 10'000'000;
+
+  // デッドラインタスク全体で使える CPU 時間の上限（2^20 = 100%）
+  const uint64_t kMaxDeadlineBandwidth = (1u << 20) * 9 / 10;
+
+  // 積が 64 ビットを溢れないよう 128 ビットで計算する（timer.cpp の TSCToNs と同様）
+  uint64_t NsToCycles(uint64_t ns) {
+    const auto cycles = static_cast<unsigned __int128>(ns) * tsc_freq / 1'000'000'000;
+    return std::min<unsigned __int128>(cycles, std::numeric_limits<uint64_t>::max());
+  }
+
+  uint64_t CyclesToNs(uint64_t cycles) {
+    const auto ns = static_cast<unsigned __int128>(cycles) * 1'000'000'000 / tsc_freq;
+    return std::min<unsigned __int128>(ns, std::numeric_limits<uint64_t>::max());
+  }
 } // namespace
 
-Task::Task(uint64_t id) : id_{id}, msgs_{} {
+Task::Task(uint64_t id)
+    : id_{id}, fpu_area_buf_(fpu_area_size + 63) {
+  const auto buf_addr = reinterpret_cast<uintptr_t>(fpu_area_buf_.data());
+  fpu_area_ = reinterpret_cast<uint8_t*>((buf_addr + 63) & ~static_cast<uintptr_t>(63));
+  InitFPUArea(fpu_area_);
 }
 
 Task& Task::InitContext(TaskFunc* f, int64_t data) {
@@ -35,9 +77,6 @@ Task& Task::InitContext(TaskFunc* f, int64_t data) {
   context_.rdi = id_;
   context_.rsi = data;
 
-  // MXCSR のすべての例外をマスクする
-  *reinterpret_cast<uint32_t*>(&context_.fxsave_area[24]) = 0x1f80;
-
   return *this;
 }
 
@@ -63,19 +102,41 @@ Task& Task::Wakeup() {
   return *this;
 }
 
-void Task::SendMessage(const Message& msg) {
-  msgs_.push_back(msg);
-  Wakeup();
+bool Task::SendMessage(const Message& msg) {
+  const bool pushed = msgs_.Push(msg);
+  Wakeup(); // 入らなかったときも，溜まったメッセージを処理させるために起こす
+  return pushed;
 }
 
 std::optional<Message> Task::ReceiveMessage() {
-  if (msgs_.empty()) {
-    return std::nullopt;
+  InterruptGuard guard;
+  auto msg = msgs_.Pop();
+  if (msg) {
+    for (Task* waiter : msg_waiters_) {
+      task_manager->Wakeup(waiter);
+    }
+    msg_waiters_.clear();
   }
-
-  auto m = msgs_.front();
-  msgs_.pop_front();
-  return m;
+  return msg;
+}
+
+TaskStats Task::Stats() const {
+  TaskStats s{};
+  s.id = id_;
+  s.level = level_;
+  s.nice = nice_;
+  s.running = running_;
+  s.msg_queue_len = msgs_.Size();
+  s.msg_queue_max = msgs_.HighWater();
+  s.msg_dropped = msgs_.Dropped();
+  s.msg_coalesced = msgs_.Coalesced();
+  s.user_ns = CyclesToNs(user_cycles_);
+  s.kernel_ns = CyclesToNs(kernel_cycles_);
+  s.voluntary_switches = voluntary_switches_;
+  s.involuntary_switches = involuntary_switches_;
+  s.page_faults = page_faults_;
+  s.syscalls = syscalls_;
+  return s;
 }
 
 std::vector<std::shared_ptr<::FileDescriptor>>& Task::Files() {
@@ -110,17 +171,24 @@ std::vector<FileMapping>& Task::FileMaps() {
   return file_maps_;
 }
 
+std::vector<SurfaceMapping>& Task::SurfaceMaps() {
+  return surface_maps_;
+}
+
 TaskManager::TaskManager() {
   Task& task = NewTask()
     .SetLevel(current_level_)
     .SetRunning(true);
   running_[current_level_].push_back(&task);
+  fpu_owner_ = &task;
 
   Task& idle = NewTask()
     .InitContext(TaskIdle, 0)
     .SetLevel(0)
     .SetRunning(true);
   running_[0].push_back(&idle);
+
+  exec_start_ = ReadTSC();
 }
 
 Task& TaskManager::NewTask() {
@@ -130,10 +198,11 @@ Task& TaskManager::NewTask() {
 
 void TaskManager::SwitchTask(const TaskContext& current_ctx) {
   TaskContext& task_ctx = task_manager->CurrentTask().Context();
-  memcpy(&task_ctx, &current_ctx, sizeof(TaskContext));
+  memcpy(&task_ctx, &current_ctx, offsetof(TaskContext, fxsave_area));
   Task* current_task = RotateCurrentRunQueue(false);
   if (&CurrentTask() != current_task) {
-    RestoreContext(&CurrentTask().Context());
+    ++current_task->involuntary_switches_;
+    RestoreContextWithFPU(&CurrentTask().Context(), &current_ctx.fxsave_area);
   }
 }
 
@@ -146,11 +215,12 @@ void TaskManager::Sleep(Task* task) {
 
   if (task == running_[current_level_].front()) {
     Task* current_task = RotateCurrentRunQueue(true);
+    ++current_task->voluntary_switches_;
     SwitchContext(&CurrentTask().Context(), &current_task->Context());
     return;
   }
 
-  Erase(running_[task->Level()], task);
+  Dequeue(task);
 }
 
 Error TaskManager::Sleep(uint64_t id) {
@@ -176,12 +246,24 @@ void TaskManager::Wakeup(Task* task, int level) {
 
   task->SetLevel(level);
   task->SetRunning(true);
+  Trace(TraceEvent::kWakeup, task->ID(), level);
 
-  running_[level].push_back(task);
-  if (level > current_level_) {
-    level_changed_ = true;
+  UpdateCurrentRuntime();
+  if (level == kFairLevel) {
+    PlaceFairTask(task, NsToCycles(kSleeperCreditNs));
+  } else if (level == kDeadlineLevel) {
+    WakeupDeadlineTask(task, exec_start_);
+  }
+  Enqueue(task);
+
+  // 起床した公平タスクが十分に先行していれば，実行中の公平タスクを横取りする
+  if (level == kFairLevel && current_level_ == kFairLevel) {
+    const Task* current_task = running_[kFairLevel].front();
+    if (task->VRuntime() + NsToCycles(kWakeupGranularityNs) <
+        current_task->VRuntime()) {
+      need_resched_ = true;
+    }
   }
-  return;
 }
 
 Error TaskManager::Wakeup(uint64_t id, int level) {
@@ -202,22 +284,60 @@ Error TaskManager::SendMessage(uint64_t id, const Message& msg) {
     return MAKE_ERROR(Error::kNoSuchTask);
   }
 
-  (*it)->SendMessage(msg);
+  if (!(*it)->SendMessage(msg)) {
+    return MAKE_ERROR(Error::kFull);
+  }
   return MAKE_ERROR(Error::kSuccess);
 }
 
+Error TaskManager::SendMessageWait(uint64_t id, const Message& msg) {
+  Task* current_task = &CurrentTask();
+  while (true) {
+    auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                           [id](const auto& t){ return t->ID() == id; });
+    if (it == tasks_.end()) {
+      return MAKE_ERROR(Error::kNoSuchTask);
+    }
+    Task* task = it->get();
+    // 他の理由で起こされた場合に備え，待ち行列に残っている自分を取り除いておく
+    auto& waiters = task->msg_waiters_;
+    waiters.erase(std::remove(waiters.begin(), waiters.end(), current_task),
+                  waiters.end());
+
+    if (task->SendMessage(msg)) {
+      return MAKE_ERROR(Error::kSuccess);
+    }
+    if (task == current_task) { // 自分宛てでは空きを待っても空かない
+      return MAKE_ERROR(Error::kFull);
+    }
+    waiters.push_back(current_task);
+    Sleep(current_task);
+  }
+}
+
 Task& TaskManager::CurrentTask() {
   return *running_[current_level_].front();
 }
 
 void TaskManager::Finish(int exit_code) {
   Task* current_task = RotateCurrentRunQueue(true);
+  if (current_task->Level() == kDeadlineLevel) {
+    deadline_bandwidth_ -= current_task->dl_bandwidth_;
+  }
+
+  // 空きを待っていた送り手に，送り先がなくなったことを知らせる
+  for (Task* waiter : current_task->msg_waiters_) {
+    Wakeup(waiter);
+  }
 
   const auto task_id = current_task->ID();
   auto it = std::find_if(
       tasks_.begin(), tasks_.end(),
       [current_task](const auto& t){ return t.get() == current_task; });
   tasks_.erase(it);
+  if (fpu_owner_ == current_task) {
+    fpu_owner_ = nullptr;
+  }
 
   finish_tasks_[task_id] = exit_code;
   if (auto it = finish_waiter_.find(task_id); it != finish_waiter_.end()) {
@@ -244,6 +364,141 @@ WithError<int> TaskManager::WaitFinish(uint64_t task_id) {
   return { exit_code, MAKE_ERROR(Error::kSuccess) };
 }
 
+void TaskManager::SetUserMode(bool user) {
+  UpdateCurrentRuntime();
+  CurrentTask().in_user_ = user;
+}
+
+size_t TaskManager::GetTaskStats(TaskStats* buf, size_t count) {
+  UpdateCurrentRuntime();
+  size_t i = 0;
+  for (; i < count && i < tasks_.size(); ++i) {
+    buf[i] = tasks_[i]->Stats();
+  }
+  return i;
+}
+
+FPUSwitch TaskManager::SwitchFPUOwner() {
+  Task* current_task = &CurrentTask();
+  if (fpu_owner_ == current_task) {
+    return { nullptr, nullptr };
+  }
+
+  Task* prev_owner = fpu_owner_;
+  fpu_owner_ = current_task;
+  return {
+    prev_owner ? prev_owner->FPUArea() : nullptr,
+    current_task->FPUArea()
+  };
+}
+
+Error TaskManager::SetNice(uint64_t id, int nice) {
+  auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                         [id](const auto& t){ return t->ID() == id; });
+  if (it == tasks_.end()) {
+    return MAKE_ERROR(Error::kNoSuchTask);
+  }
+
+  UpdateCurrentRuntime(); // 以前の重みで実行した分を先に反映する
+  (*it)->nice_ = std::clamp(nice, kMinNice, kMaxNice);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error TaskManager::SetDeadline(uint64_t id, uint64_t runtime_ns,
+                               uint64_t period_ns, uint64_t deadline_ns) {
+  auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                         [id](const auto& t){ return t->ID() == id; });
+  if (it == tasks_.end()) {
+    return MAKE_ERROR(Error::kNoSuchTask);
+  }
+  Task* task = it->get();
+
+  const uint64_t old_bandwidth =
+    task->Level() == kDeadlineLevel ? task->dl_bandwidth_ : 0;
+
+  if (runtime_ns == 0) {
+    deadline_bandwidth_ -= old_bandwidth;
+    task->dl_bandwidth_ = 0;
+    if (task->Level() == kDeadlineLevel) {
+      ChangeLevel(task, kFairLevel);
+      task->dl_throttled_ = false;
+    }
+    return MAKE_ERROR(Error::kSuccess);
+  }
+
+  const uint64_t bandwidth = (runtime_ns << 20) / period_ns;
+  if (deadline_bandwidth_ - old_bandwidth + bandwidth > kMaxDeadlineBandwidth) {
+    return MAKE_ERROR(Error::kBandwidthExceeded);
+  }
+  deadline_bandwidth_ = deadline_bandwidth_ - old_bandwidth + bandwidth;
+
+  UpdateCurrentRuntime();
+  // 待ち行列の中にあるタスクのデッドラインを書き換える前に一旦取り出す
+  const bool queued = task->Running() && task != &CurrentTask() &&
+                      task->Level() == kDeadlineLevel;
+  if (queued) {
+    Dequeue(task);
+  }
+  task->dl_bandwidth_ = bandwidth;
+  task->dl_runtime_ = NsToCycles(runtime_ns);
+  task->dl_period_ = NsToCycles(period_ns);
+  task->dl_deadline_ = NsToCycles(deadline_ns);
+  task->dl_throttled_ = false;
+  StartDeadlinePeriod(task, exec_start_);
+  if (queued) {
+    Enqueue(task);
+  } else if (task->Level() != kDeadlineLevel) {
+    ChangeLevel(task, kDeadlineLevel);
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+void TaskManager::UpdateDeadlines() {
+  UpdateCurrentRuntime();
+  const uint64_t now = exec_start_;
+
+  // 実行時間が残っているのにデッドラインを過ぎたタスクは次の周期に移す
+  if (current_level_ == kDeadlineLevel) {
+    Task* current_task = running_[kDeadlineLevel].front();
+    if (current_task->dl_budget_ > 0 && current_task->dl_abs_deadline_ < now) {
+      ++current_task->dl_misses_;
+      StartDeadlinePeriod(current_task, now);
+    }
+  }
+  while (!deadline_queue_.empty()) {
+    Task* task = *deadline_queue_.begin();
+    if (task->dl_abs_deadline_ >= now) {
+      break;
+    }
+    deadline_queue_.erase(deadline_queue_.begin());
+    ++task->dl_misses_;
+    StartDeadlinePeriod(task, now);
+    deadline_queue_.insert(task);
+  }
+
+  // 補充の時刻を迎えたタスクを実行待ち行列に戻す
+  for (auto it = throttled_.begin(); it != throttled_.end();) {
+    Task* task = *it;
+    if (task->dl_replenish_at_ > now) {
+      ++it;
+      continue;
+    }
+
+    it = throttled_.erase(it);
+    task->dl_throttled_ = false;
+    uint64_t start = task->dl_replenish_at_;
+    if (start + task->dl_deadline_ <= now) {
+      start = now;
+    }
+    StartDeadlinePeriod(task, start);
+    Enqueue(task);
+    if (current_level_ == kDeadlineLevel &&
+        task->dl_abs_deadline_ < running_[kDeadlineLevel].front()->dl_abs_deadline_) {
+      need_resched_ = true;
+    }
+  }
+}
+
 void TaskManager::ChangeLevelRunning(Task* task, int level) {
   if (level < 0 || level == task->Level()) {
     return;
@@ -251,16 +506,24 @@ void TaskManager::ChangeLevelRunning(Task* task, int level) {
 
   if (task != running_[current_level_].front()) {
     // change level of other task
-    Erase(running_[task->Level()], task);
-    running_[level].push_back(task);
+    Dequeue(task);
     task->SetLevel(level);
-    if (level > current_level_) {
-      level_changed_ = true;
+    if (level == kFairLevel) {
+      PlaceFairTask(task, 0);
+    }
+    Enqueue(task);
+    if (level == kDeadlineLevel && current_level_ == kDeadlineLevel &&
+        task->dl_abs_deadline_ < running_[kDeadlineLevel].front()->dl_abs_deadline_) {
+      need_resched_ = true;
     }
     return;
   }
 
   // change level myself
+  UpdateCurrentRuntime();
+  if (level == kFairLevel) {
+    PlaceFairTask(task, 0);
+  }
   running_[current_level_].pop_front();
   running_[level].push_front(task);
   task->SetLevel(level);
@@ -273,29 +536,180 @@ void TaskManager::ChangeLevelRunning(Task* task, int level) {
 }
 
 Task* TaskManager::RotateCurrentRunQueue(bool current_sleep) {
+  UpdateCurrentRuntime();
+  need_resched_ = false;
+
   auto& level_queue = running_[current_level_];
   Task* current_task = level_queue.front();
   level_queue.pop_front();
   if (!current_sleep) {
-    level_queue.push_back(current_task);
+    if (current_level_ == kDeadlineLevel && current_task->dl_budget_ <= 0) {
+      ThrottleDeadlineTask(current_task, exec_start_);
+    }
+    Enqueue(current_task);
   }
-  if (level_queue.empty()) {
+  if (LevelEmpty(current_level_)) {
     level_changed_ = true;
   }
 
   if (level_changed_) {
     level_changed_ = false;
     for (int lv = kMaxLevel; lv >= 0; --lv) {
-      if (!running_[lv].empty()) {
+      if (!LevelEmpty(lv)) {
         current_level_ = lv;
         break;
       }
     }
   }
 
+  if (current_level_ == kFairLevel && running_[kFairLevel].empty()) {
+    // vruntime が最小のタスクを選ぶ
+    auto it = fair_queue_.begin();
+    running_[kFairLevel].push_back(*it);
+    fair_queue_.erase(it);
+  } else if (current_level_ == kDeadlineLevel &&
+             running_[kDeadlineLevel].empty()) {
+    // デッドラインが最も早いタスクを選び，実行時間を使い切る時刻に割り込みを予約する
+    auto it = deadline_queue_.begin();
+    Task* next_task = *it;
+    running_[kDeadlineLevel].push_back(next_task);
+    deadline_queue_.erase(it);
+    ArmSchedulerTimer(next_task->dl_budget_);
+  }
+
+  if (current_task != running_[current_level_].front()) {
+    Trace(TraceEvent::kTaskSwitch, current_task->ID(), CurrentTask().ID());
+  }
   return current_task;
 }
 
+bool TaskManager::LevelEmpty(int level) const {
+  return running_[level].empty() &&
+    (level != kFairLevel || fair_queue_.empty()) &&
+    (level != kDeadlineLevel || deadline_queue_.empty());
+}
+
+// 実行中でないタスクを実行待ち行列に入れる
+void TaskManager::Enqueue(Task* task) {
+  if (task->Level() == kFairLevel) {
+    fair_queue_.insert(task);
+  } else if (task->Level() == kDeadlineLevel) {
+    if (task->dl_throttled_) {
+      throttled_.push_back(task);
+      return;
+    }
+    deadline_queue_.insert(task);
+  } else {
+    running_[task->Level()].push_back(task);
+  }
+
+  if (task->Level() > current_level_) {
+    level_changed_ = true;
+    need_resched_ = true;
+  }
+}
+
+// 実行中でないタスクを実行待ち行列から取り除く
+void TaskManager::Dequeue(Task* task) {
+  if (task->Level() == kFairLevel) {
+    fair_queue_.erase(task);
+  } else if (task->Level() == kDeadlineLevel) {
+    if (task->dl_throttled_) {
+      Erase(throttled_, task);
+    } else {
+      deadline_queue_.erase(task);
+    }
+  } else {
+    Erase(running_[task->Level()], task);
+  }
+}
+
+// 実行中かどうかに関わらずタスクのレベルを変える
+void TaskManager::ChangeLevel(Task* task, int level) {
+  if (task->Running()) {
+    ChangeLevelRunning(task, level);
+  } else {
+    task->SetLevel(level);
+  }
+}
+
+// 前回の呼び出しからの実行時間を現在のタスクに加算する
+void TaskManager::UpdateCurrentRuntime() {
+  const uint64_t now = ReadTSC();
+  const uint64_t delta = now - exec_start_;
+  exec_start_ = now;
+
+  Task* current_task = running_[current_level_].front();
+  if (current_task->in_user_) {
+    current_task->user_cycles_ += delta;
+  } else {
+    current_task->kernel_cycles_ += delta;
+  }
+
+  if (current_level_ == kDeadlineLevel) {
+    current_task->dl_budget_ -= delta;
+    if (current_task->dl_budget_ <= 0) {
+      need_resched_ = true;
+    }
+    return;
+  }
+  if (current_level_ != kFairLevel) {
+    return;
+  }
+
+  current_task->vruntime_ +=
+    delta * kNice0Weight / kNiceToWeight[current_task->nice_ - kMinNice];
+
+  uint64_t min_vruntime = current_task->vruntime_;
+  if (!fair_queue_.empty()) {
+    min_vruntime = std::min(min_vruntime, (*fair_queue_.begin())->vruntime_);
+  }
+  min_vruntime_ = std::max(min_vruntime_, min_vruntime);
+}
+
+// 公平タスクの vruntime が min_vruntime_ - credit より小さければ引き上げる
+void TaskManager::PlaceFairTask(Task* task, uint64_t credit) {
+  const uint64_t floor = min_vruntime_ > credit ? min_vruntime_ - credit : 0;
+  task->vruntime_ = std::max(task->vruntime_, floor);
+}
+
+void TaskManager::StartDeadlinePeriod(Task* task, uint64_t start) {
+  task->dl_abs_deadline_ = start + task->dl_deadline_;
+  task->dl_budget_ = task->dl_runtime_;
+}
+
+// 起床したデッドラインタスクに CBS の規則を適用する
+void TaskManager::WakeupDeadlineTask(Task* task, uint64_t now) {
+  if (task->dl_budget_ <= 0 && now < task->dl_replenish_at_) {
+    ThrottleDeadlineTask(task, now);
+    return;
+  }
+
+  // 残りの実行時間をデッドラインまでに使うと帯域を超えるなら，新しい周期を始める
+  if (task->dl_abs_deadline_ <= now || task->dl_budget_ <= 0 ||
+      static_cast<unsigned __int128>(task->dl_budget_) * task->dl_period_ >
+      static_cast<unsigned __int128>(task->dl_abs_deadline_ - now) * task->dl_runtime_) {
+    StartDeadlinePeriod(task, now);
+  }
+}
+
+// 実行時間を使い切ったタスクを次の周期の始まりまで止める
+void TaskManager::ThrottleDeadlineTask(Task* task, uint64_t now) {
+  if (task->dl_abs_deadline_ < now) {
+    ++task->dl_misses_;
+  }
+  task->dl_throttled_ = true;
+  task->dl_replenish_at_ =
+    task->dl_abs_deadline_ - task->dl_deadline_ + task->dl_period_;
+  ArmSchedulerTimer(task->dl_replenish_at_ > now ? task->dl_replenish_at_ - now : 0);
+}
+
+// UpdateDeadlines() が呼ばれるよう，指定したサイクル数の後に割り込みを起こす
+void TaskManager::ArmSchedulerTimer(uint64_t cycles_from_now) {
+  timer_manager->AddTimerNs(
+      Timer{CurrentTimeNs() + CyclesToNs(cycles_from_now), kTaskTimerValue, 0});
+}
+
 TaskManager* task_manager;
 
 void InitializeTask() {
@@ -311,3 +725,21 @@ __attribute__((no_caller_saved_registers))
 extern "C" uint64_t GetCurrentTaskOSStackPointer() {
   return task_manager->CurrentTask().OSStackPointer();
 }
+
+__attribute__((no_caller_saved_registers))
+extern "C" void SyscallEntered(uint32_t number) {
+  Trace(TraceEvent::kSyscallEnter, number);
+  task_manager->SetUserMode(false);
+  task_manager->CurrentTask().CountSyscall();
+}
+
+__attribute__((no_caller_saved_registers))
+extern "C" void SyscallReturning(uint64_t number, int error) {
+  task_manager->SetUserMode(true);
+  Trace(TraceEvent::kSyscallExit, number & 0x7fffffff, error);
+}
+
+__attribute__((no_caller_saved_registers))
+extern "C" FPUSwitch SwitchFPUOwner() {
+  return task_manager->SwitchFPUOwner();
+}
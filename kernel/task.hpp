@@ -12,23 +12,32 @@
 #include <deque>
 #include <map>
 #include <optional>
+#include <set>
 #include <vector>
 
 #include "error.hpp"
 #include "message.hpp"
+#include "message_queue.hpp"
 #include "paging.hpp"
 #include "fat.hpp"
+#include "task_stats.hpp"
 
 struct TaskContext {
   uint64_t cr3, rip, rflags, reserved1; // offset 0x00
   uint64_t cs, ss, fs, gs; // offset 0x20
   uint64_t rax, rbx, rcx, rdx, rdi, rsi, rsp, rbp; // offset 0x40
   uint64_t r8, r9, r10, r11, r12, r13, r14, r15; // offset 0x80
-  std::array<uint8_t, 512> fxsave_area; // offset 0xc0
+  std::array<uint8_t, 512> fxsave_area; // offset 0xc0（割り込みハンドラのスタック上でのみ使う）
 } __attribute__((packed));
 
 using TaskFunc = void (uint64_t, int64_t);
 
+/** @brief #NM 例外で FPU/SSE の状態を入れ替えるときに使う領域 */
+struct FPUSwitch {
+  void* save_area;    // 直前の所有者の状態の保存先（保存不要なら nullptr）
+  void* restore_area; // 現在のタスクの状態の復帰元（復帰不要なら nullptr）
+};
+
 class TaskManager;
 
 struct FileMapping {
@@ -36,6 +45,12 @@ struct FileMapping {
   uint64_t vaddr_begin, vaddr_end;
 };
 
+/** @brief アプリのアドレス空間に割り当てたウィンドウの影バッファ */
+struct SurfaceMapping {
+  unsigned int layer_id;
+  uint64_t vaddr_begin, vaddr_end;
+};
+
 class Task {
  public:
   static const int kDefaultLevel = 1;
@@ -44,11 +59,15 @@ class Task {
   Task(uint64_t id);
   Task& InitContext(TaskFunc* f, int64_t data);
   TaskContext& Context();
+  /** @brief FPU/SSE/AVX の状態保存領域（fpu_area_size バイト，64 バイト境界） */
+  uint8_t* FPUArea() { return fpu_area_; }
   uint64_t& OSStackPointer();
   uint64_t ID() const;
   Task& Sleep();
   Task& Wakeup();
-  void SendMessage(const Message& msg);
+  /** @brief メッセージを送ってタスクを起こす．キューが満杯で入らなければ false を返す */
+  bool SendMessage(const Message& msg);
+  /** @brief 先頭のメッセージを取り出し，空きを待っている送り手がいれば起こす */
   std::optional<Message> ReceiveMessage();
   std::vector<std::shared_ptr<::FileDescriptor>>& Files();
   uint64_t DPagingBegin() const;
@@ -58,22 +77,57 @@ class Task {
   uint64_t FileMapEnd() const;
   void SetFileMapEnd(uint64_t v);
   std::vector<FileMapping>& FileMaps();
+  std::vector<SurfaceMapping>& SurfaceMaps();
 
   int Level() const { return level_; }
   bool Running() const { return running_; }
+  /** @brief nice 値（-20 〜 19，小さいほど多くの CPU 時間を得る） */
+  int Nice() const { return nice_; }
+  /** @brief 公平スケジューリングで使う仮想実行時間（TSC サイクル，nice で重み付け） */
+  uint64_t VRuntime() const { return vruntime_; }
+  /** @brief デッドラインスケジューリングで現在の周期の絶対デッドライン（TSC 値） */
+  uint64_t AbsDeadline() const { return dl_abs_deadline_; }
+  /** @brief デッドラインを守れなかった回数 */
+  uint64_t DeadlineMisses() const { return dl_misses_; }
+
+  /** @brief 統計情報を返す（時間は ns に換算する） */
+  TaskStats Stats() const;
+  void CountSyscall() { ++syscalls_; }
+  void CountPageFault() { ++page_faults_; }
 
  private:
   uint64_t id_;
   std::vector<uint64_t> stack_;
   alignas(16) TaskContext context_;
+  std::vector<uint8_t> fpu_area_buf_;
+  uint8_t* fpu_area_;
   uint64_t os_stack_ptr_;
-  std::deque<Message> msgs_;
+  MessageQueue msgs_;
+  std::vector<Task*> msg_waiters_{}; // msgs_ の空きを待って眠っている送り手
   unsigned int level_{kDefaultLevel};
   bool running_{false};
+  int nice_{0};
+  uint64_t vruntime_{0};
+
+  // デッドラインスケジューリングのパラメータ（TSC サイクル）と状態
+  uint64_t dl_runtime_{0}, dl_period_{0}, dl_deadline_{0};
+  uint64_t dl_bandwidth_{0}; // dl_runtime_ / dl_period_ を 2^20 倍した値
+  uint64_t dl_abs_deadline_{0};
+  int64_t dl_budget_{0};     // 現在の周期で残っている実行時間
+  uint64_t dl_replenish_at_{0};
+  bool dl_throttled_{false}; // 実行時間を使い切り，次の周期まで実行できない
+  uint64_t dl_misses_{0};
+
+  // CPU 時間の計測（TSC サイクル）と各種の回数
+  bool in_user_{false}; // アプリのコードを実行中なら true
+  uint64_t user_cycles_{0}, kernel_cycles_{0};
+  uint64_t voluntary_switches_{0}, involuntary_switches_{0};
+  uint64_t page_faults_{0}, syscalls_{0};
   std::vector<std::shared_ptr<::FileDescriptor>> files_{};
   uint64_t dpaging_begin_{0}, dpaging_end_{0};
   uint64_t file_map_end_{0};
   std::vector<FileMapping> file_maps_{};
+  std::vector<SurfaceMapping> surface_maps_{};
 
   Task& SetLevel(int level) { level_ = level; return *this; }
   Task& SetRunning(bool running) { running_ = running; return *this; }
@@ -81,10 +135,37 @@ class Task {
   friend TaskManager;
 };
 
+/** @brief 公平スケジューリングの実行待ち行列の順序（vruntime が小さい順） */
+struct VRuntimeLess {
+  bool operator()(const Task* lhs, const Task* rhs) const {
+    if (lhs->VRuntime() != rhs->VRuntime()) {
+      return lhs->VRuntime() < rhs->VRuntime();
+    }
+    return lhs->ID() < rhs->ID();
+  }
+};
+
+/** @brief デッドラインスケジューリングの実行待ち行列の順序（デッドラインが早い順） */
+struct DeadlineLess {
+  bool operator()(const Task* lhs, const Task* rhs) const {
+    if (lhs->AbsDeadline() != rhs->AbsDeadline()) {
+      return lhs->AbsDeadline() < rhs->AbsDeadline();
+    }
+    return lhs->ID() < rhs->ID();
+  }
+};
+
 class TaskManager {
  public:
   // level: 0 = lowest, kMaxLevel = highest
+  // kFairLevel のタスクは vruntime に基づいて公平に，kDeadlineLevel のタスクは
+  // EDF（CBS による実行時間の制限付き）で，それ以外のレベルはラウンドロビンで
+  // スケジュールされる。上のレベルが常に優先される。
   static const int kMaxLevel = 3;
+  static const int kFairLevel = Task::kDefaultLevel;
+  static const int kDeadlineLevel = 2;
+  static const int kMinNice = -20;
+  static const int kMaxNice = 19;
 
   TaskManager();
   Task& NewTask();
@@ -94,22 +175,80 @@ class TaskManager {
   Error Sleep(uint64_t id);
   void Wakeup(Task* task, int level = -1);
   Error Wakeup(uint64_t id, int level = -1);
+  /** @brief メッセージを送る．キューが満杯で入らなければ kFull を返す */
   Error SendMessage(uint64_t id, const Message& msg);
+  /** @brief 送り先のキューに空きができるまで現在のタスクを眠らせてでもメッセージを送る．
+   *
+   * 捨てられると困るメッセージ（パイプのデータなど）に使う．割り込みを禁止して呼ぶ．
+   * 待っている間に送り先が終了したら kNoSuchTask を返す．
+   */
+  Error SendMessageWait(uint64_t id, const Message& msg);
   Task& CurrentTask();
   void Finish(int exit_code);
   WithError<int> WaitFinish(uint64_t task_id);
+  Error SetNice(uint64_t id, int nice);
+
+  /** @brief タスクをデッドラインスケジューリングの対象にする。
+   *
+   * 周期 period_ns ごとに，周期の始まりから deadline_ns 以内に runtime_ns の
+   * 実行時間を保証する。runtime_ns が 0 なら公平スケジューリングに戻す。
+   * 全タスクの runtime/period の和が上限を超える場合は kBandwidthExceeded を返す。
+   */
+  Error SetDeadline(uint64_t id, uint64_t runtime_ns,
+                    uint64_t period_ns, uint64_t deadline_ns);
+
+  /** @brief タイマー割り込みごとに呼び，実行時間の消費と補充を処理する。 */
+  void UpdateDeadlines();
+
+  /** @brief 優先すべきタスクが起床していて，次の tick で切り替えるべきなら true */
+  bool NeedResched() const { return need_resched_; }
+
+  /** @brief 現在のタスクがアプリのコードを実行しているかを切り替える．
+   *
+   * それまでの実行時間をユーザー／カーネルのどちらかに計上してから切り替える．
+   */
+  void SetUserMode(bool user);
+
+  /** @brief 全タスクの統計情報を buf に最大 count 個書き込み，書き込んだ数を返す */
+  size_t GetTaskStats(TaskStats* buf, size_t count);
+
+  /** @brief FPU/SSE レジスタの所有者を現在のタスクに移す．
+   *
+   * #NM 例外ハンドラから呼ばれる．SSE レジスタを壊してはならない．
+   */
+  FPUSwitch SwitchFPUOwner();
 
  private:
   std::vector<std::unique_ptr<Task>> tasks_{};
   uint64_t latest_id_{0};
+  // running_[kFairLevel] には fair_queue_ から選ばれて実行中のタスクだけが入る
   std::array<std::deque<Task*>, kMaxLevel + 1> running_{};
+  std::set<Task*, VRuntimeLess> fair_queue_{};
+  // running_[kDeadlineLevel] も同様に deadline_queue_ から選ばれたタスクだけが入る
+  std::set<Task*, DeadlineLess> deadline_queue_{};
+  std::vector<Task*> throttled_{}; // 実行時間の補充を待つデッドラインタスク
+  uint64_t deadline_bandwidth_{0};
+  uint64_t min_vruntime_{0};
+  uint64_t exec_start_{0}; // 現在のタスクが実行を始めた TSC 値
   int current_level_{kMaxLevel};
   bool level_changed_{false};
+  bool need_resched_{false};
   std::map<uint64_t, int> finish_tasks_{}; // key: ID of a finished task
   std::map<uint64_t, Task*> finish_waiter_{}; // key: ID of a finished task
+  Task* fpu_owner_{nullptr}; // FPU/SSE レジスタの内容を所有するタスク
 
   void ChangeLevelRunning(Task* task, int level);
   Task* RotateCurrentRunQueue(bool current_sleep);
+  bool LevelEmpty(int level) const;
+  void Enqueue(Task* task);
+  void Dequeue(Task* task);
+  void UpdateCurrentRuntime();
+  void PlaceFairTask(Task* task, uint64_t credit);
+  void ChangeLevel(Task* task, int level);
+  void StartDeadlinePeriod(Task* task, uint64_t start);
+  void WakeupDeadlineTask(Task* task, uint64_t now);
+  void ThrottleDeadlineTask(Task* task, uint64_t now);
+  void ArmSchedulerTimer(uint64_t cycles_from_now);
 };
 
 extern TaskManager* task_manager;
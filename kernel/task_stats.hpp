@@ -0,0 +1,40 @@
+/**
+ * @file task_stats.hpp
+ *
+ * タスクごとの CPU 時間などの統計情報の定義．
+ * アプリからも読み込まれるため C 言語と互換な記述にする．
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief GetTaskStats システムコールで現在のタスクだけを取得する */
+#define TASK_STATS_SELF 0
+/** @brief GetTaskStats システムコールで全タスクを取得する */
+#define TASK_STATS_ALL  1
+
+struct TaskStats {
+  uint64_t id;
+  int32_t level;
+  int32_t nice;
+  uint32_t running;               // 実行可能状態なら 1
+  uint32_t msg_queue_len;         // 未処理のメッセージ数
+  uint64_t msg_queue_max;         // メッセージキューの長さの最大値
+  uint64_t user_ns;               // ユーザーモードで動いた時間
+  uint64_t kernel_ns;             // カーネルモードで動いた時間
+  uint64_t voluntary_switches;    // 自ら眠ったことによるコンテキストスイッチの回数
+  uint64_t involuntary_switches;  // 横取りされたことによるコンテキストスイッチの回数
+  uint64_t page_faults;
+  uint64_t syscalls;
+  uint64_t msg_dropped;           // キューが満杯で捨てたメッセージ数
+  uint64_t msg_coalesced;         // 連続する kMouseMove をまとめた数
+};
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
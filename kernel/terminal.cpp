@@ -10,9 +10,13 @@
 #include "layer.hpp"
 #include "pci.hpp"
 #include "asmfunc.h"
+#include "blit.hpp"
 #include "elf.hpp"
 #include "memory_manager.hpp"
 #include "paging.hpp"
+#include "interrupt.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
 #include "timer.hpp"
 #include "keyboard.hpp"
 #include "logger.hpp"
@@ -74,6 +78,97 @@ WithError<int> MakeArgVector(char* command, char* first_arg,
   return { argc, MAKE_ERROR(Error::kSuccess) };
 }
 
+// 書き込み用にファイルを探し，無ければ作る
+WithError<fat::DirectoryEntry*> FindOrCreateFile(const char* path) {
+  auto [ file, post_slash ] = fat::FindFile(path);
+  if (file == nullptr) {
+    return fat::CreateFile(path);
+  } else if (file->attr == fat::Attribute::kDirectory || post_slash) {
+    return { nullptr, MAKE_ERROR(Error::kIsDirectory) };
+  }
+  return { file, MAKE_ERROR(Error::kSuccess) };
+}
+
+// 各転送処理の速さを，よくあるウィンドウの大きさについて GB/s で表示する
+void BenchBlit(FileDescriptor& out) {
+  const Vector2D<int> kSizes[] = {{64, 64}, {320, 240}, {640, 480}, {1024, 768}};
+  const int kStride = 1024;  // 画面の 1 行に見立てる
+  const uint64_t kMinDurationNs = 50'000'000;
+  const uint32_t kKey = 0x00ff00ff;
+
+  std::vector<uint32_t> src(kStride * 768), dst(kStride * 768);
+  for (size_t i = 0; i < src.size(); ++i) {
+    // 8 ピクセルごとに透過色（アルファ値 0）と，アルファ値がばらばらのピクセルを交互に置く
+    src[i] = (i / 8) % 2 ? kKey : static_cast<uint32_t>(i * 2654435761u);
+  }
+
+  size_t num_kernels;
+  const auto kernels = AvailableBlitKernels(num_kernels);
+  PrintToFD(out, "%-7s %9s %10s %10s %10s %10s\n",
+            "kernel", "size", "copy", "copy_key", "fill", "blend");
+  for (size_t k = 0; k < num_kernels; ++k) {
+    const auto& kernel = *kernels[k];
+    for (const auto& size : kSizes) {
+      // 1 回の処理で矩形全体を扱い，kMinDurationNs を超えるまで繰り返す
+      auto measure = [&](auto f) {
+        uint64_t iterations = 0;
+        const uint64_t start = CurrentTimeNs();
+        uint64_t elapsed;
+        do {
+          for (int y = 0; y < size.y; ++y) {
+            f(&dst[kStride * y], &src[kStride * y], size.x);
+          }
+          ++iterations;
+          elapsed = CurrentTimeNs() - start;
+        } while (elapsed < kMinDurationNs);
+        // 1 バイト/ns が 1 GB/s．小数点以下 2 桁まで出す
+        return iterations * size.x * size.y * sizeof(uint32_t) * 100 / elapsed;
+      };
+      const auto copy = measure([&](uint32_t* d, const uint32_t* s, int n) {
+        kernel.copy(d, s, n);
+      });
+      const auto copy_key = measure([&](uint32_t* d, const uint32_t* s, int n) {
+        kernel.copy_key(d, s, n, kKey);
+      });
+      const auto fill = measure([&](uint32_t* d, const uint32_t*, int n) {
+        kernel.fill(d, n, 0x00123456);
+      });
+      const auto blend = measure([&](uint32_t* d, const uint32_t* s, int n) {
+        kernel.blend(d, s, n);
+      });
+
+      char size_str[16];
+      snprintf(size_str, sizeof(size_str), "%dx%d", size.x, size.y);
+      PrintToFD(out, "%-7s %9s %7lu.%02lu %7lu.%02lu %7lu.%02lu %7lu.%02lu\n",
+                kernel.name, size_str, copy / 100, copy % 100,
+                copy_key / 100, copy_key % 100, fill / 100, fill % 100,
+                blend / 100, blend % 100);
+    }
+  }
+  PrintToFD(out, "(GB/s, current: %s)\n", blit_kernels->name);
+}
+
+// 端末に文字を書き出す速さを，1 秒あたりの文字数で表示する
+void BenchText(Terminal& term, FileDescriptor& out) {
+  const int kLines = 500;
+  char line[Terminal::kColumns + 1];
+  for (int i = 0; i < Terminal::kColumns - 1; ++i) {
+    line[i] = ' ' + (i % 95);
+  }
+  line[Terminal::kColumns - 1] = '\n';
+  line[Terminal::kColumns] = 0;
+
+  TerminalFileDescriptor fd{term};
+  const uint64_t start = CurrentTimeNs();
+  for (int i = 0; i < kLines; ++i) {
+    fd.Write(line, Terminal::kColumns);
+  }
+  const uint64_t elapsed = CurrentTimeNs() - start;
+  const uint64_t chars = kLines * Terminal::kColumns;
+  PrintToFD(out, "%lu chars in %lu us: %lu chars/s\n",
+            chars, elapsed / 1000, elapsed ? chars * 1'000'000'000 / elapsed : 0);
+}
+
 Elf64_Phdr* GetProgramHeader(Elf64_Ehdr* ehdr) {
   return reinterpret_cast<Elf64_Phdr*>(
       reinterpret_cast<uintptr_t>(ehdr) + ehdr->e_phoff);
@@ -297,6 +392,7 @@ Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
         screen_config.pixel_format,
         "MikanTerm");
     DrawTerminal(*window_->InnerWriter(), {0, 0}, window_->InnerSize());
+    SetScrollback(kDefaultScrollback);
 
     layer_id_ = layer_manager->NewLayer()
       .SetWindow(window_)
@@ -308,18 +404,12 @@ Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
   cmd_history_.resize(8);
 }
 
-Rectangle<int> Terminal::BlinkCursor() {
-  cursor_visible_ = !cursor_visible_;
-  DrawCursor(cursor_visible_);
-
-  return {CalcCursorPos(), {7, 15}};
-}
-
-void Terminal::DrawCursor(bool visible) {
-  if (show_window_) {
-    const auto color = visible ? ToColor(0xffffff) : ToColor(0);
-    FillRectangle(*window_->Writer(), CalcCursorPos(), {7, 15}, color);
+void Terminal::BlinkCursor() {
+  {
+    InterruptGuard guard;
+    cursor_visible_ = !cursor_visible_;
   }
+  ScheduleFlush();
 }
 
 Vector2D<int> Terminal::CalcCursorPos() const {
@@ -327,71 +417,289 @@ Vector2D<int> Terminal::CalcCursorPos() const {
       Vector2D<int>{4 + 8 * cursor_.x, 4 + 16 * cursor_.y};
 }
 
-Rectangle<int> Terminal::InputKey(
+void Terminal::InputKey(
     uint8_t modifier, uint8_t keycode, char ascii) {
-  DrawCursor(false);
-
-  Rectangle<int> draw_area{CalcCursorPos(), {8*2, 16}};
-
   if (ascii == '\n') {
-    linebuf_[linebuf_index_] = 0;
-    if (linebuf_index_ > 0) {
-      cmd_history_.pop_back();
-      cmd_history_.push_front(linebuf_);
-    }
-    linebuf_index_ = 0;
-    cmd_history_index_ = -1;
+    {
+      InterruptGuard guard;
+      SnapToBottom();
+      linebuf_[linebuf_index_] = 0;
+      if (linebuf_index_ > 0) {
+        cmd_history_.pop_back();
+        cmd_history_.push_front(linebuf_);
+      }
+      linebuf_index_ = 0;
+      cmd_history_index_ = -1;
 
-    cursor_.x = 0;
-    if (cursor_.y < kRows - 1) {
-      ++cursor_.y;
-    } else {
-      Scroll1();
+      cursor_.x = 0;
+      if (cursor_.y < kRows - 1) {
+        ++cursor_.y;
+      } else {
+        Scroll1();
+      }
     }
     ExecuteLine();
     Print(">");
-    draw_area.pos = ToplevelWindow::kTopLeftMargin;
-    draw_area.size = window_->InnerSize();
-  } else if (ascii == '\b') {
-    if (cursor_.x > 1) {
-      --cursor_.x;
-      if (show_window_) {
-        FillRectangle(*window_->Writer(), CalcCursorPos(), {8, 16}, {0, 0, 0});
+    return;
+  }
+
+  {
+    InterruptGuard guard;
+    if (ascii == '\b') {
+      SnapToBottom();
+      if (cursor_.x > 1) {
+        --cursor_.x;
+        ClearCells(cursor_.y, cursor_.x, cursor_.x + 1);
+        if (linebuf_index_ > 0) {
+          --linebuf_index_;
+        }
       }
-      draw_area.pos = CalcCursorPos();
+    } else if (ascii != 0) {
+      SnapToBottom();
+      if (cursor_.x < kColumns - 1 && linebuf_index_ < kLineMax - 1) {
+        linebuf_[linebuf_index_] = ascii;
+        ++linebuf_index_;
+        PutCell(cursor_, {static_cast<uint8_t>(ascii), {255, 255, 255}, 0});
+        ++cursor_.x;
+      }
+    } else if (keycode == 0x51) { // down arrow
+      SnapToBottom();
+      HistoryUpDown(-1);
+    } else if (keycode == 0x52) { // up arrow
+      SnapToBottom();
+      HistoryUpDown(1);
+    } else if (keycode == 0x4b) { // page up
+      ScrollView(kRows - 1);
+    } else if (keycode == 0x4e) { // page down
+      ScrollView(-(kRows - 1));
+    }
+    cursor_visible_ = true;
+  }
+  ScheduleFlush();
+}
 
-      if (linebuf_index_ > 0) {
-        --linebuf_index_;
+Terminal::Line& Terminal::ScreenLine(int row) {
+  return lines_[(screen_top_ + row) % lines_.size()];
+}
+
+const Terminal::Line& Terminal::ViewLine(int row) const {
+  return lines_[(screen_top_ + lines_.size() - view_offset_ + row) % lines_.size()];
+}
+
+void Terminal::MarkDirty(int row, int begin, int end) {
+  auto& d = dirty_[row];
+  if (d.begin >= d.end) {
+    d = {begin, end};
+  } else {
+    d = {std::min(d.begin, begin), std::max(d.end, end)};
+  }
+}
+
+void Terminal::PutCell(Vector2D<int> pos, const Cell& cell) {
+  if (!show_window_) {
+    return;
+  }
+  auto& line = ScreenLine(pos.y);
+  // 全角文字の片側だけを上書きするなら，もう片側も消す
+  if ((line[pos.x].attr & kCellWide) && pos.x + 1 < kColumns) {
+    line[pos.x + 1] = {0, line[pos.x].color, 0};
+    MarkDirty(pos.y, pos.x + 1, pos.x + 2);
+  } else if ((line[pos.x].attr & kCellWideRight) && pos.x > 0) {
+    line[pos.x - 1] = {0, line[pos.x].color, 0};
+    MarkDirty(pos.y, pos.x - 1, pos.x);
+  }
+  line[pos.x] = cell;
+  MarkDirty(pos.y, pos.x, pos.x + 1);
+}
+
+void Terminal::ClearCells(int row, int begin, int end) {
+  for (int x = begin; x < end; ++x) {
+    PutCell({x, row}, {0, {255, 255, 255}, 0});
+  }
+}
+
+void Terminal::SnapToBottom() {
+  if (view_offset_ != 0) {
+    view_offset_ = 0;
+    full_redraw_ = true;
+  }
+}
+
+void Terminal::SetScrollback(int lines) {
+  InterruptGuard guard;
+  // 画面の行だけを引き継ぎ，スクロールバックは捨てる
+  std::vector<Line> new_lines(lines + kRows);
+  for (auto& line : new_lines) {
+    line.fill({0, {255, 255, 255}, 0});
+  }
+  if (!lines_.empty()) {
+    for (int row = 0; row < kRows; ++row) {
+      new_lines[row] = ScreenLine(row);
+    }
+  }
+  lines_.swap(new_lines);
+  screen_top_ = 0;
+  history_ = 0;
+  view_offset_ = 0;
+  full_redraw_ = true;
+}
+
+void Terminal::ScrollView(int delta) {
+  const int new_offset = std::clamp(view_offset_ + delta, 0, history_);
+  if (new_offset != view_offset_) {
+    view_offset_ = new_offset;
+    full_redraw_ = true;
+  }
+}
+
+void Terminal::Scroll1() {
+  if (!show_window_) {
+    return;
+  }
+  screen_top_ = (screen_top_ + 1) % lines_.size();
+  history_ = std::min<int>(history_ + 1, lines_.size() - kRows);
+  ScreenLine(kRows - 1).fill({0, {255, 255, 255}, 0});
+
+  // 描画済みのウィンドウも Flush で同じだけずらすので，未描画の範囲も一緒にずらす
+  std::copy(dirty_.begin() + 1, dirty_.end(), dirty_.begin());
+  dirty_[kRows - 1] = {0, kColumns};
+  ++pending_scroll_;
+}
+
+void Terminal::ScheduleFlush() {
+  InterruptGuard guard;
+  if (!show_window_ || flush_scheduled_) {
+    return;
+  }
+  flush_scheduled_ = true;
+  layer_manager->RequestFrameCallback(
+      [](void* arg) { reinterpret_cast<Terminal*>(arg)->Flush(); }, this);
+}
+
+void Terminal::Flush() {
+  const Vector2D<int> origin = ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4};
+  int first_row = kRows, last_row = -1; // ウィンドウで描き変えた行の範囲
+
+  // 描き直す範囲と行の内容だけを割り込み禁止で写し取り，描画はその後で行う
+  std::array<DirtyRange, kRows> dirty;
+  int scroll;
+  bool draw_cursor;
+  Vector2D<int> cursor;
+  {
+    InterruptGuard guard;
+    flush_scheduled_ = false;
+    dirty = dirty_;
+    dirty_.fill({0, 0});
+    scroll = full_redraw_ || pending_scroll_ >= kRows ? kRows : pending_scroll_;
+    full_redraw_ = false;
+    pending_scroll_ = 0;
+    draw_cursor = cursor_visible_ && view_offset_ == 0;
+    cursor = cursor_;
+
+    if (scroll == kRows) {
+      dirty.fill({0, kColumns});
+      drawn_cursor_.reset();
+    } else if (drawn_cursor_) {
+      drawn_cursor_->y -= scroll;
+      if (drawn_cursor_->y < 0) {
+        drawn_cursor_.reset();
       }
     }
-  } else if (ascii != 0) {
-    if (cursor_.x < kColumns - 1 && linebuf_index_ < kLineMax - 1) {
-      linebuf_[linebuf_index_] = ascii;
-      ++linebuf_index_;
-      if (show_window_) {
-        WriteAscii(*window_->Writer(), CalcCursorPos(), ascii, {255, 255, 255});
+    // 前回描いたカーソルの下のセルも描き直す
+    if (drawn_cursor_ && drawn_cursor_->x < kColumns) {
+      auto& d = dirty[drawn_cursor_->y];
+      const int x = drawn_cursor_->x;
+      d = d.begin < d.end ? DirtyRange{std::min(d.begin, x), std::max(d.end, x + 1)}
+                          : DirtyRange{x, x + 1};
+    }
+    for (int row = 0; row < kRows; ++row) {
+      if (dirty[row].begin < dirty[row].end) {
+        flush_lines_[row] = ViewLine(row);
       }
-      ++cursor_.x;
     }
-  } else if (keycode == 0x51) { // down arrow
-    draw_area = HistoryUpDown(-1);
-  } else if (keycode == 0x52) { // up arrow
-    draw_area = HistoryUpDown(1);
   }
 
-  DrawCursor(true);
+  if (0 < scroll && scroll < kRows) {
+    // 何行スクロールしても，描画済みの行を 1 回ずらすだけで済ませる
+    window_->Move(origin, {origin + Vector2D<int>{0, 16 * scroll},
+                           {8 * kColumns, 16 * (kRows - scroll)}});
+    first_row = 0;
+    last_row = kRows - 1;
+  }
+
+  // 前回描いたカーソルを消す
+  if (drawn_cursor_) {
+    const auto c = *drawn_cursor_;
+    FillRectangle(*window_->Writer(),
+                  origin + Vector2D<int>{8 * c.x, 16 * c.y}, {7, 15}, {0, 0, 0});
+    first_row = std::min(first_row, c.y);
+    last_row = std::max(last_row, c.y);
+    drawn_cursor_.reset();
+  }
+
+  for (int row = 0; row < kRows; ++row) {
+    const auto& d = dirty[row];
+    if (d.begin < d.end) {
+      DrawRow(flush_lines_[row], row, d.begin, d.end);
+      first_row = std::min(first_row, row);
+      last_row = std::max(last_row, row);
+    }
+  }
+
+  if (draw_cursor) {
+    FillRectangle(*window_->Writer(), origin + Vector2D<int>{8 * cursor.x, 16 * cursor.y},
+                  {7, 15}, {255, 255, 255});
+    drawn_cursor_ = cursor;
+    first_row = std::min(first_row, cursor.y);
+    last_row = std::max(last_row, cursor.y);
+  }
 
-  return draw_area;
+  if (first_row <= last_row) {
+    layer_manager->Draw(layer_id_, {
+        {ToplevelWindow::kTopLeftMargin.x, origin.y + 16 * first_row},
+        {window_->InnerSize().x, 16 * (last_row - first_row + 1)}});
+  }
 }
 
-void Terminal::Scroll1() {
-  Rectangle<int> move_src{
-    ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4 + 16},
-    {8*kColumns, 16*(kRows - 1)}
-  };
-  window_->Move(ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4}, move_src);
-  FillRectangle(*window_->InnerWriter(),
-                {4, 4 + 16*cursor_.y}, {8*kColumns, 16}, {0, 0, 0});
+void Terminal::DrawRow(const Line& line, int row, int begin, int end) {
+  if (begin > 0 && (line[begin].attr & kCellWideRight)) {
+    --begin;
+  }
+  if (end < kColumns && (line[end - 1].attr & kCellWide)) {
+    ++end;
+  }
+
+  auto& writer = *window_->Writer();
+  const Vector2D<int> row_pos =
+    ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4 + 16 * row};
+  FillRectangle(writer, row_pos + Vector2D<int>{8 * begin, 0},
+                {8 * (end - begin), 16}, {0, 0, 0});
+
+  char ascii[kColumns];
+  for (int x = begin; x < end;) {
+    const auto& cell = line[x];
+    if (cell.c == 0 || (cell.attr & kCellWideRight)) {
+      ++x;
+    } else if (cell.attr & kCellWide) {
+      WriteUnicode(writer, row_pos + Vector2D<int>{8 * x, 0}, cell.c, cell.color);
+      x += 2;
+    } else {
+      // 同じ色の半角文字の並びはまとめて描く
+      int n = 0;
+      while (x + n < end && line[x + n].c != 0 && line[x + n].c <= 0x7f &&
+             line[x + n].attr == 0 && line[x + n].color == cell.color) {
+        ascii[n] = line[x + n].c;
+        ++n;
+      }
+      if (n == 0) {
+        WriteUnicode(writer, row_pos + Vector2D<int>{8 * x, 0}, cell.c, cell.color);
+        n = 1;
+      } else {
+        WriteAsciiString(writer, row_pos + Vector2D<int>{8 * x, 0}, ascii, n, cell.color);
+      }
+      x += n;
+    }
+  }
 }
 
 void Terminal::ExecuteLine() {
@@ -479,10 +787,29 @@ void Terminal::ExecuteLine() {
     PrintToFD(*files_[1], "\n");
   } else if (strcmp(command, "clear") == 0) {
     if (show_window_) {
-      FillRectangle(*window_->InnerWriter(),
-                    {4, 4}, {8*kColumns, 16*kRows}, {0, 0, 0});
+      InterruptGuard guard;
+      SnapToBottom();
+      for (int row = 0; row < kRows; ++row) {
+        ScreenLine(row).fill({0, {255, 255, 255}, 0});
+      }
+      full_redraw_ = true;
     }
     cursor_.y = 0;
+  } else if (strcmp(command, "scrollback") == 0) {
+    // scrollback [<行数>]
+    if (first_arg) {
+      const long lines = strtol(first_arg, nullptr, 0);
+      if (lines < 0 || lines > kMaxScrollback) {
+        PrintToFD(*files_[2], "invalid scrollback: %s\n", first_arg);
+        exit_code = 1;
+      } else if (show_window_) {
+        SetScrollback(lines);
+        ScheduleFlush();
+      }
+    }
+    if (show_window_) {
+      PrintToFD(*files_[1], "scrollback: %lu lines\n", lines_.size() - kRows);
+    }
   } else if (strcmp(command, "lspci") == 0) {
     for (int i = 0; i < pci::num_device; ++i) {
       const auto& dev = pci::devices[i];
@@ -549,7 +876,6 @@ void Terminal::ExecuteLine() {
     }
     if (fd) {
       char u8buf[1024];
-      DrawCursor(false);
       while (true) {
         size_t read_size = ReadDelim(*fd, '\n', u8buf, sizeof(u8buf));
         if (read_size == 0) {
@@ -557,7 +883,6 @@ void Terminal::ExecuteLine() {
         }
         files_[1]->Write(u8buf, read_size);
       }
-      DrawCursor(true);
     }
   } else if (strcmp(command, "noterm") == 0) {
     auto term_desc = new TerminalDescriptor{
@@ -589,6 +914,140 @@ void Terminal::ExecuteLine() {
         PrintToFD(*files_[1], "-%02d%02d\n", -t.TimeZone / 60, -t.TimeZone % 60);
       }
     }
+  } else if (strcmp(command, "nice") == 0) {
+    [&]{
+      // nice <nice 値> [<タスク ID>]（タスク ID を省略するとこのターミナル）
+      char* endp = nullptr;
+      const long nice = first_arg ? strtol(first_arg, &endp, 0) : 0;
+      if (!first_arg || endp == first_arg) {
+        PrintToFD(*files_[2], "Usage: nice <value> [<task id>]\n");
+        exit_code = 1;
+        return;
+      }
+      uint64_t task_id = task_.ID();
+      if (*endp != '\0') {
+        task_id = strtoul(endp, nullptr, 0);
+      }
+
+      __asm__("cli");
+      auto err = task_manager->SetNice(task_id, nice);
+      __asm__("sti");
+      if (err) {
+        PrintToFD(*files_[2], "failed to set nice: %s\n", err.Name());
+        exit_code = 1;
+      }
+    }();
+  } else if (strcmp(command, "profile") == 0) {
+    [&]{
+      // profile start [<Hz>] / profile stop [<ファイル名>]
+      char* sub_arg = first_arg ? strchr(first_arg, ' ') : nullptr;
+      if (sub_arg) {
+        *sub_arg = 0;
+        ++sub_arg;
+      }
+
+      if (first_arg && strcmp(first_arg, "start") == 0) {
+        const long hz = sub_arg ? strtol(sub_arg, nullptr, 0) : 1000;
+        if (hz <= 0 || hz > 100'000) {
+          PrintToFD(*files_[2], "invalid sampling rate: %ld\n", hz);
+          exit_code = 1;
+          return;
+        }
+        StartProfiler(1'000'000'000 / hz);
+        return;
+      } else if (!first_arg || strcmp(first_arg, "stop") != 0) {
+        PrintToFD(*files_[2], "Usage: profile start [<Hz>] | profile stop [<file>]\n");
+        exit_code = 1;
+        return;
+      }
+
+      const size_t n = StopProfiler();
+      PrintToFD(*files_[1], "%lu samples\n", n);
+      if (!sub_arg) {
+        return;
+      }
+
+      auto [ file, err ] = FindOrCreateFile(sub_arg);
+      if (err) {
+        PrintToFD(*files_[2], "failed to open %s: %s\n", sub_arg, err.Name());
+        exit_code = 1;
+        return;
+      }
+      fat::FileDescriptor fd{*file};
+      const size_t lines = WriteProfile(fd);
+      PrintToFD(*files_[1], "%lu stacks written to %s\n", lines, sub_arg);
+    }();
+  } else if (strcmp(command, "trace") == 0) {
+    [&]{
+      // trace start / trace stop / trace dump <ファイル名>
+      char* sub_arg = first_arg ? strchr(first_arg, ' ') : nullptr;
+      if (sub_arg) {
+        *sub_arg = 0;
+        ++sub_arg;
+      }
+
+      if (first_arg && strcmp(first_arg, "start") == 0) {
+        StartTrace();
+      } else if (first_arg && strcmp(first_arg, "stop") == 0) {
+        StopTrace();
+      } else if (first_arg && strcmp(first_arg, "dump") == 0 && sub_arg) {
+        StopTrace();
+        auto [ file, err ] = FindOrCreateFile(sub_arg);
+        if (err) {
+          PrintToFD(*files_[2], "failed to open %s: %s\n", sub_arg, err.Name());
+          exit_code = 1;
+          return;
+        }
+        fat::FileDescriptor fd{*file};
+        const size_t n = WriteTrace(fd);
+        PrintToFD(*files_[1], "%lu records written to %s\n", n, sub_arg);
+      } else {
+        PrintToFD(*files_[2], "Usage: trace start | trace stop | trace dump <file>\n");
+        exit_code = 1;
+      }
+    }();
+  } else if (strcmp(command, "compositor") == 0) {
+    // compositor [<最大の合成回数 (Hz)>]
+    if (first_arg) {
+      const long hz = strtol(first_arg, nullptr, 0);
+      if (hz <= 0 || hz > 1000) {
+        PrintToFD(*files_[2], "invalid refresh rate: %s\n", first_arg);
+        exit_code = 1;
+      } else {
+        __asm__("cli");
+        layer_manager->SetRefreshRate(hz);
+        __asm__("sti");
+      }
+    }
+    __asm__("cli");
+    const auto stats = layer_manager->Stats();
+    __asm__("sti");
+    PrintToFD(*files_[1], "refresh rate: %u Hz\n", stats.refresh_rate);
+    PrintToFD(*files_[1], "frames/s: %u\n", stats.last_second_frames);
+    PrintToFD(*files_[1], "pixels/frame: %lu (last), %lu (avg)\n",
+              stats.last_frame_pixels,
+              stats.frames ? stats.pixels / stats.frames : 0);
+    PrintToFD(*files_[1], "frames: %lu, pixels: %lu\n", stats.frames, stats.pixels);
+  } else if (strcmp(command, "fontstat") == 0) {
+    const auto stats = GetGlyphCacheStats();
+    const uint64_t lookups = stats.hits + stats.misses;
+    const uint64_t permille = lookups ? stats.hits * 1000 / lookups : 0;
+    PrintToFD(*files_[1], "glyph cache: %lu / %lu entries\n", stats.entries, stats.capacity);
+    PrintToFD(*files_[1], "hits: %lu, misses: %lu (hit rate %lu.%lu%%)\n",
+              stats.hits, stats.misses, permille / 10, permille % 10);
+    PrintToFD(*files_[1], "evictions: %lu\n", stats.evictions);
+  } else if (strcmp(command, "dmesg") == 0) {
+    DumpLog(*files_[1]);
+  } else if (strcmp(command, "bench") == 0) {
+    // bench blit / bench text
+    if (first_arg && strcmp(first_arg, "blit") == 0) {
+      BenchBlit(*files_[1]);
+    } else if (first_arg && strcmp(first_arg, "text") == 0) {
+      BenchText(*this, *files_[1]);
+    } else {
+      PrintToFD(*files_[2], "Usage: bench blit | bench text\n");
+      exit_code = 1;
+    }
   } else if (strcmp(command, "reboot") == 0) {
     uefi_rt->ResetSystem(EfiResetWarm, EFI_SUCCESS, 0, nullptr);
   } else if (strcmp(command, "poweroff") == 0) {
@@ -784,14 +1243,30 @@ WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry,
   task.SetDPagingBegin(elf_next_page);
   task.SetDPagingEnd(elf_next_page);
 
-  task.SetFileMapEnd(stack_frame_addr.value);
+  if (auto err = MapSharedPage(LinearAddress4Level{TIME_PAGE_ADDR},
+                               reinterpret_cast<uint64_t>(&time_page_frame))) {
+    return { 0, err };
+  }
+
+  task.SetFileMapEnd(TIME_PAGE_ADDR);
 
+  __asm__("cli");
+  task_manager->SetUserMode(true);
+  __asm__("sti");
   int ret = CallApp(argc.value, argv, 3 << 3 | 3, app_load.entry,
                     stack_frame_addr.value + stack_size - 8,
                     &task.OSStackPointer());
 
   task.Files().clear();
   task.FileMaps().clear();
+  // 共有した影バッファのページは CleanPageMaps で外れ，フレームはウィンドウが持ち続ける
+  task.SurfaceMaps().clear();
+
+  // アプリがデッドラインクラスに移っていたら公平クラスに戻す
+  __asm__("cli");
+  task_manager->SetUserMode(false);
+  task_manager->SetDeadline(task.ID(), 0, 0, 0);
+  __asm__("sti");
 
   if (auto err = CleanPageMaps(LinearAddress4Level{0xffff'8000'0000'0000})) {
     return { ret, err };
@@ -880,74 +1355,69 @@ void Terminal::Print(char32_t c) {
     if (cursor_.x == kColumns) {
       newline();
     }
-    WriteUnicode(*window_->Writer(), CalcCursorPos(), c, text_color_);
+    PutCell(cursor_, {c, text_color_, 0});
     ++cursor_.x;
   } else {
     if (cursor_.x >= kColumns - 1) {
       newline();
     }
-    WriteUnicode(*window_->Writer(), CalcCursorPos(), c, text_color_);
+    PutCell(cursor_, {c, text_color_, kCellWide});
+    PutCell(cursor_ + Vector2D<int>{1, 0}, {0, text_color_, kCellWideRight});
     cursor_.x += 2;
   }
 }
 
 void Terminal::Print(const char* s, std::optional<size_t> len) {
-  const auto cursor_before = CalcCursorPos();
-  DrawCursor(false);
-
   size_t i = 0;
   const size_t len_ = len ? *len : std::numeric_limits<size_t>::max();
 
-  while (s[i] && i < len_) {
-    const auto [ u32, bytes ] = ConvertUTF8To32(&s[i]);
-    if (bytes > 0) {
-      Print(u32);
-      i += bytes;
-    } else { // UTF-8 文字ではない
-      Print('?');
-      i++;
+  // 長い出力でも割り込みを長く止めないよう，kPrintChunk バイトごとに区切って書き込む
+  do {
+    InterruptGuard guard;
+    if (show_window_) {
+      SnapToBottom();
     }
-  }
-
-  DrawCursor(true);
-  const auto cursor_after = CalcCursorPos();
-
-  Vector2D<int> draw_pos{ToplevelWindow::kTopLeftMargin.x, cursor_before.y};
-  Vector2D<int> draw_size{window_->InnerSize().x,
-                          cursor_after.y - cursor_before.y + 16};
-
-  Rectangle<int> draw_area{draw_pos, draw_size};
-
-  Message msg = MakeLayerMessage(
-      task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
-  __asm__("cli");
-  task_manager->SendMessage(1, msg);
-  __asm__("sti");
-}
 
-void Terminal::Redraw() {
-  Rectangle<int> draw_area{ToplevelWindow::kTopLeftMargin,
-                           window_->InnerSize()};
+    const size_t chunk_end = i + kPrintChunk;
+    while (i < len_ && s[i] && i < chunk_end) {
+      // 行に収まる表示可能な ASCII 文字の並びは，そのままセルに書き込む
+      if (show_window_ && esc_seq_state_ == EscSeqState::kInit && cursor_.x < kColumns) {
+        size_t n = 0;
+        while (i + n < len_ && cursor_.x + n < kColumns &&
+               0x20 <= s[i + n] && s[i + n] < 0x7f) {
+          PutCell(cursor_ + Vector2D<int>{static_cast<int>(n), 0},
+                  {static_cast<char32_t>(s[i + n]), text_color_, 0});
+          ++n;
+        }
+        if (n > 0) {
+          cursor_.x += n;
+          i += n;
+          continue;
+        }
+      }
 
-  Message msg = MakeLayerMessage(
-      task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
-  __asm__("cli");
-  task_manager->SendMessage(1, msg);
-  __asm__("sti");
+      const auto [ u32, bytes ] = ConvertUTF8To32(&s[i]);
+      if (bytes > 0) {
+        Print(u32);
+        i += bytes;
+      } else { // UTF-8 文字ではない
+        Print('?');
+        i++;
+      }
+    }
+    cursor_visible_ = true;
+  } while (i < len_ && s[i]);
+  ScheduleFlush();
 }
 
-Rectangle<int> Terminal::HistoryUpDown(int direction) {
+void Terminal::HistoryUpDown(int direction) {
   if (direction == -1 && cmd_history_index_ >= 0) {
     --cmd_history_index_;
   } else if (direction == 1 && cmd_history_index_ + 1 < cmd_history_.size()) {
     ++cmd_history_index_;
   }
 
-  cursor_.x = 1;
-  const auto first_pos = CalcCursorPos();
-
-  Rectangle<int> draw_area{first_pos, {8*(kColumns - 1), 16}};
-  FillRectangle(*window_->Writer(), draw_area.pos, draw_area.size, {0, 0, 0});
+  ClearCells(cursor_.y, 1, kColumns);
 
   const char* history = "";
   if (cmd_history_index_ >= 0) {
@@ -957,9 +1427,11 @@ Rectangle<int> Terminal::HistoryUpDown(int direction) {
   strcpy(&linebuf_[0], history);
   linebuf_index_ = strlen(history);
 
-  WriteString(*window_->Writer(), first_pos, history, {255, 255, 255});
-  cursor_.x = linebuf_index_ + 1;
-  return draw_area;
+  for (int i = 0; i < linebuf_index_ && 1 + i < kColumns; ++i) {
+    PutCell({1 + i, cursor_.y},
+            {static_cast<uint8_t>(history[i]), {255, 255, 255}, 0});
+  }
+  cursor_.x = std::min(linebuf_index_ + 1, kColumns);
 }
 
 void TaskTerminal(uint64_t task_id, int64_t data) {
@@ -1014,26 +1486,14 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
     case Message::kTimerTimeout:
       add_blink_timer(msg->arg.timer.timeout);
       if (show_window && window_isactive) {
-        const auto area = terminal->BlinkCursor();
-        Message msg = MakeLayerMessage(
-            task_id, terminal->LayerID(), LayerOperation::DrawArea, area);
-        __asm__("cli");
-        task_manager->SendMessage(1, msg);
-        __asm__("sti");
+        terminal->BlinkCursor();
       }
       break;
     case Message::kKeyPush:
       if (msg->arg.keyboard.press) {
-        const auto area = terminal->InputKey(msg->arg.keyboard.modifier,
-                                             msg->arg.keyboard.keycode,
-                                             msg->arg.keyboard.ascii);
-        if (show_window) {
-          Message msg = MakeLayerMessage(
-              task_id, terminal->LayerID(), LayerOperation::DrawArea, area);
-          __asm__("cli");
-          task_manager->SendMessage(1, msg);
-          __asm__("sti");
-        }
+        terminal->InputKey(msg->arg.keyboard.modifier,
+                           msg->arg.keyboard.keycode,
+                           msg->arg.keyboard.ascii);
       }
       break;
     case Message::kWindowActive:
@@ -1081,14 +1541,13 @@ size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
 
     bufc[0] = msg->arg.keyboard.ascii;
     term_.Print(bufc, 1);
-    term_.Redraw();
     return 1;
   }
 }
 
 size_t TerminalFileDescriptor::Write(const void* buf, size_t len) {
+  // 描画は次の合成フレームでまとめて行われるので，ここでは文字を書き込むだけ
   term_.Print(reinterpret_cast<const char*>(buf), len);
-  term_.Redraw();
   return len;
 }
 
@@ -1096,7 +1555,7 @@ size_t TerminalFileDescriptor::Load(void* buf, size_t len, size_t offset) {
   return 0;
 }
 
-PipeDescriptor::PipeDescriptor(Task& task) : task_{task} {
+PipeDescriptor::PipeDescriptor(Task& task) : task_{task}, task_id_{task.ID()} {
 }
 
 size_t PipeDescriptor::Read(void* buf, size_t len) {
@@ -1145,10 +1604,14 @@ size_t PipeDescriptor::Write(const void* buf, size_t len) {
   while (sent_bytes < len) {
     msg.arg.pipe.len = std::min(len - sent_bytes, sizeof(msg.arg.pipe.data));
     memcpy(msg.arg.pipe.data, &bufc[sent_bytes], msg.arg.pipe.len);
-    sent_bytes += msg.arg.pipe.len;
+    // 読み手が追いつくまで待ち，パイプのデータは決して捨てない
     __asm__("cli");
-    task_.SendMessage(msg);
+    auto err = task_manager->SendMessageWait(task_id_, msg);
     __asm__("sti");
+    if (err) { // 読み手が終了した
+      return sent_bytes;
+    }
+    sent_bytes += msg.arg.pipe.len;
   }
   return len;
 }
@@ -1156,7 +1619,8 @@ size_t PipeDescriptor::Write(const void* buf, size_t len) {
 void PipeDescriptor::FinishWrite() {
   Message msg{Message::kPipe};
   msg.arg.pipe.len = 0;
+  // 終端のメッセージが届かないと，読み手はいつまでも待ち続ける
   __asm__("cli");
-  task_.SendMessage(msg);
+  task_manager->SendMessageWait(task_id_, msg);
   __asm__("sti");
 }
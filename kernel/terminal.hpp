@@ -11,6 +11,7 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <vector>
 #include "window.hpp"
 #include "task.hpp"
 #include "layer.hpp"
@@ -38,32 +39,80 @@ enum class EscSeqState {
   kNum,  // 数字を 1 文字以上受信した状態
 };
 
+/** @brief ターミナルは文字のセル（コードポイント，色，属性）の格子として内容を保持する。
+ *
+ * 出力はセルを書き換えて変化した行の範囲を記録するだけで，ウィンドウへの描画は
+ * 合成の直前に 1 フレームにつき 1 回だけ行う（Flush）。それまでの途中の状態は描かない。
+ * 画面から押し出された行はリングバッファにスクロールバックとして残す。
+ * セルは出力するタスクとメインタスク（Flush）の両方が触るので，割り込みを禁止して扱う。
+ * ただし禁止するのは短い間だけにする：Print は一定のバイト数ごとに区切って書き込み，
+ * Flush は描き直す行を写し取ってから割り込みを許可して描く。
+ */
 class Terminal {
  public:
   static const int kRows = 15, kColumns = 60;
   static const int kLineMax = 128;
+  static const int kDefaultScrollback = 256;
+  static const int kMaxScrollback = 4096;
+  static const size_t kPrintChunk = 256; // Print が割り込みを禁止したまま処理する最大バイト数
 
   Terminal(Task& task, const TerminalDescriptor* term_desc);
   unsigned int LayerID() const { return layer_id_; }
-  Rectangle<int> BlinkCursor();
-  Rectangle<int> InputKey(uint8_t modifier, uint8_t keycode, char ascii);
+  void BlinkCursor();
+  void InputKey(uint8_t modifier, uint8_t keycode, char ascii);
 
   void Print(const char* s, std::optional<size_t> len = std::nullopt);
 
   Task& UnderlyingTask() const { return task_; }
   int LastExitCode() const { return last_exit_code_; }
-  void Redraw();
 
  private:
+  /** @brief 画面の 1 文字分 */
+  struct Cell {
+    char32_t c;       // 0 なら空白
+    PixelColor color;
+    uint8_t attr;
+  };
+  static const uint8_t kCellWide = 1;      // 全角文字の左半分
+  static const uint8_t kCellWideRight = 2; // 全角文字の右半分（c は使わない）
+  using Line = std::array<Cell, kColumns>;
+
+  /** @brief 行の中で描き直しが必要な列の範囲 [begin, end) */
+  struct DirtyRange {
+    int begin, end;
+  };
+
   std::shared_ptr<ToplevelWindow> window_;
   unsigned int layer_id_;
   Task& task_;
 
   Vector2D<int> cursor_{0, 0};
   bool cursor_visible_{false};
-  void DrawCursor(bool visible);
   Vector2D<int> CalcCursorPos() const;
 
+  std::vector<Line> lines_{};    // スクロールバックと画面の行のリングバッファ
+  size_t screen_top_{0};         // 画面の 0 行目に当たる lines_ の添え字
+  int history_{0};               // 画面より上に残っている行数
+  int view_offset_{0};           // 何行さかのぼって表示しているか
+  std::array<DirtyRange, kRows> dirty_{};
+  int pending_scroll_{0};        // 前回の Flush からスクロールした行数
+  bool full_redraw_{true};
+  bool flush_scheduled_{false};
+  std::optional<Vector2D<int>> drawn_cursor_{}; // 最後にカーソルを描いたセル
+  std::array<Line, kRows> flush_lines_{}; // Flush が描く行の写し
+
+  Line& ScreenLine(int row);
+  const Line& ViewLine(int row) const;
+  void MarkDirty(int row, int begin, int end);
+  void PutCell(Vector2D<int> pos, const Cell& cell);
+  void ClearCells(int row, int begin, int end);
+  void SnapToBottom();
+  void SetScrollback(int lines);
+  void ScrollView(int delta);
+  void ScheduleFlush();
+  void Flush();
+  void DrawRow(const Line& line, int row, int begin, int end);
+
   int linebuf_index_{0};
   std::array<char, kLineMax> linebuf_{};
   void Scroll1();
@@ -75,7 +124,7 @@ class Terminal {
 
   std::deque<std::array<char, kLineMax>> cmd_history_{};
   int cmd_history_index_{-1};
-  Rectangle<int> HistoryUpDown(int direction);
+  void HistoryUpDown(int direction);
 
   bool show_window_;
   std::array<std::shared_ptr<FileDescriptor>, 3> files_;
@@ -113,6 +162,7 @@ class PipeDescriptor : public FileDescriptor {
 
  private:
   Task& task_;
+  const uint64_t task_id_; // 書き込みは ID で送り，読み手が終了していても壊れない
   char data_[16];
   size_t len_{0};
   bool closed_{false};
@@ -0,0 +1,36 @@
+/**
+ * @file time_page.hpp
+ *
+ * アプリのアドレス空間に読み込み専用で割り当てる時刻ページの定義．
+ * アプリからも読み込まれるため C 言語と互換な記述にする．
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief 時刻ページを割り当てる仮想アドレス（アプリ用スタックの直下）． */
+#define TIME_PAGE_ADDR 0xfffffffffffee000ull
+
+/** @brief カーネルが tick ごとに更新する時刻情報．
+ *
+ * 書き込み側は seq を奇数にしてから各フィールドを更新し，最後に偶数に戻す．
+ * 読み出し側は seq が偶数で，かつ読み出しの前後で変化していないことを確認する．
+ */
+struct TimePage {
+  uint32_t seq;
+  uint32_t timer_freq;         // tick の周波数 (Hz)
+  uint64_t tick;               // 起動時からの tick 数
+  uint64_t tsc_freq;           // TSC の周波数 (Hz)．0 なら TSC を時計源にできない
+  uint64_t tsc_base;           // 起動時からの ns = ((TSC - tsc_base) * tsc_to_ns_mult) >> 32
+  uint64_t tsc_to_ns_mult;
+  int64_t realtime_offset_ns;  // UNIX 時刻 (ns) = 起動時からの ns + realtime_offset_ns
+};
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -1,8 +1,16 @@
 #include "timer.hpp"
 
+#include <algorithm>
+
 #include "acpi.hpp"
+#include "asmfunc.h"
 #include "interrupt.hpp"
+#include "logger.hpp"
+#include "msr.hpp"
+#include "profiler.hpp"
 #include "task.hpp"
+#include "trace.hpp"
+#include "uefi.hpp"
 
 namespace {
   const uint32_t kCountMax = 0xffffffffu;
@@ -10,6 +18,80 @@ namespace {
   volatile uint32_t& initial_count = *reinterpret_cast<uint32_t*>(0xfee00380);
   volatile uint32_t& current_count = *reinterpret_cast<uint32_t*>(0xfee00390);
   volatile uint32_t& divide_config = *reinterpret_cast<uint32_t*>(0xfee003e0);
+
+  // LAPIC タイマーと TSC の較正に使う時間
+  const unsigned long kCalibrationMillis = 10;
+
+  bool tsc_deadline_mode = false;
+  uint64_t tsc_base;        // CurrentTimeNs() が 0 を返す TSC 値
+  uint64_t tsc_to_ns_mult;  // ns = (tsc * tsc_to_ns_mult) >> 32
+  uint64_t ns_to_tsc_mult;  // tsc = (ns * ns_to_tsc_mult) >> 24
+  uint64_t tsc_per_tick;
+  uint64_t next_tick_tsc;   // TSC-deadline モードで次の tick を起こす TSC 値
+
+  bool HasInvariantTSC() {
+    uint32_t a, b, c, d;
+    CPUID(0x80000000, 0, &a, &b, &c, &d);
+    if (a < 0x80000007) {
+      return false;
+    }
+    CPUID(0x80000007, 0, &a, &b, &c, &d);
+    return d & (1u << 8);
+  }
+
+  bool HasTSCDeadline() {
+    uint32_t a, b, c, d;
+    CPUID(1, 0, &a, &b, &c, &d);
+    return c & (1u << 24);
+  }
+
+  uint64_t TSCToNs(uint64_t tsc) {
+    return (static_cast<unsigned __int128>(tsc - tsc_base) * tsc_to_ns_mult) >> 32;
+  }
+
+  uint64_t NsToTSC(uint64_t ns) {
+    const auto delta = (static_cast<unsigned __int128>(ns) * ns_to_tsc_mult) >> 24;
+    if (delta >= std::numeric_limits<uint64_t>::max() - tsc_base) {
+      return std::numeric_limits<uint64_t>::max();
+    }
+    return tsc_base + static_cast<uint64_t>(delta);
+  }
+
+  // 次の tick と最も早いナノ秒タイマーのうち，早い方の時刻に割り込みを予約する
+  void ArmTSCDeadline() {
+    const uint64_t deadline = std::min<uint64_t>(
+        next_tick_tsc, NsToTSC(timer_manager->NextTimeoutNs()));
+    WriteMSR(kIA32_TSC_DEADLINE, deadline);
+  }
+
+  // 1970-01-01 からの日数
+  int64_t DaysFromCivil(int y, unsigned int m, unsigned int d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned int yoe = y - era * 400;
+    const unsigned int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+  }
+
+  // 読み出し側が一貫した値を得られるよう seq を奇数にしてから書き換える
+  template <class F>
+  void WriteTimePage(F f) {
+    auto& page = time_page_frame.page;
+    page.seq = page.seq + 1;
+    __asm__ volatile("" ::: "memory");
+    f(page);
+    __asm__ volatile("" ::: "memory");
+    page.seq = page.seq + 1;
+  }
+
+  // 通知できたか，送り先のタスクがもういなければ true
+  bool NotifyTimeout(const Timer& t) {
+    Message m{Message::kTimerTimeout};
+    m.arg.timer.timeout = t.Timeout();
+    m.arg.timer.value = t.Value();
+    return task_manager->SendMessage(t.TaskID(), m).Cause() != Error::kFull;
+  }
 }
 
 void InitializeLAPICTimer() {
@@ -18,12 +100,36 @@ void InitializeLAPICTimer() {
   divide_config = 0b1011; // divide 1:1
   lvt_timer = 0b001 << 16; // masked, one-shot
 
+  // LAPIC タイマーと TSC を同じ区間で ACPI PM タイマーに対して較正する
   StartLAPICTimer();
-  acpi::WaitMilliseconds(100);
+  const uint64_t tsc_start = ReadTSC();
+  acpi::WaitMilliseconds(kCalibrationMillis);
+  const uint64_t tsc_end = ReadTSC();
   const auto elapsed = LAPICTimerElapsed();
   StopLAPICTimer();
 
-  lapic_timer_freq = static_cast<unsigned long>(elapsed) * 10;
+  lapic_timer_freq = static_cast<unsigned long>(elapsed) * (1000 / kCalibrationMillis);
+
+  tsc_freq = (tsc_end - tsc_start) * (1000 / kCalibrationMillis);
+  tsc_invariant = HasInvariantTSC();
+  if (tsc_invariant) {
+    tsc_base = tsc_start;
+    tsc_to_ns_mult = (1'000'000'000ul << 32) / tsc_freq;
+    ns_to_tsc_mult = (tsc_freq << 24) / 1'000'000'000ul;
+    tsc_per_tick = tsc_freq / kTimerFreq;
+    tsc_deadline_mode = HasTSCDeadline();
+  }
+  Log(kInfo, "LAPIC timer %lu Hz, TSC %lu Hz (%s), TSC-deadline %s\n",
+      lapic_timer_freq, tsc_freq, tsc_invariant ? "invariant" : "variant",
+      tsc_deadline_mode ? "on" : "off");
+
+  if (tsc_deadline_mode) {
+    lvt_timer = (0b100 << 16) | InterruptVector::kLAPICTimer; // not-masked, TSC-deadline
+    __asm__("mfence"); // LVT の書き込みを WRMSR より先に完了させる
+    next_tick_tsc = ReadTSC() + tsc_per_tick;
+    ArmTSCDeadline();
+    return;
+  }
 
   divide_config = 0b1011; // divide 1:1
   lvt_timer = (0b010 << 16) | InterruptVector::kLAPICTimer; // not-masked, periodic
@@ -42,20 +148,71 @@ void StopLAPICTimer() {
   initial_count = 0;
 }
 
+uint64_t CurrentTimeNs() {
+  if (!tsc_invariant) {
+    return timer_manager->CurrentTick() * (1'000'000'000ul / kTimerFreq);
+  }
+  return TSCToNs(ReadTSC());
+}
+
+void InitializeTimePage() {
+  EFI_TIME t;
+  uefi_rt->GetTime(&t, nullptr);
+  int64_t unix_sec = DaysFromCivil(t.Year, t.Month, t.Day) * 86400 +
+                     t.Hour * 3600 + t.Minute * 60 + t.Second;
+  if (t.TimeZone != EFI_UNSPECIFIED_TIMEZONE) {
+    unix_sec -= t.TimeZone * 60;
+  }
+  const int64_t unix_ns = unix_sec * 1'000'000'000 + t.Nanosecond;
+
+  __asm__("cli");
+  WriteTimePage([unix_ns](TimePage& page) {
+    page.timer_freq = kTimerFreq;
+    page.tick = timer_manager->CurrentTick();
+    page.tsc_freq = tsc_invariant ? tsc_freq : 0;
+    page.tsc_base = tsc_base;
+    page.tsc_to_ns_mult = tsc_to_ns_mult;
+    page.realtime_offset_ns = unix_ns - static_cast<int64_t>(CurrentTimeNs());
+  });
+  __asm__("sti");
+}
+
 Timer::Timer(unsigned long timeout, int value, uint64_t task_id)
     : timeout_{timeout}, value_{value}, task_id_{task_id} {
 }
 
 TimerManager::TimerManager() {
   timers_.push(Timer{std::numeric_limits<unsigned long>::max(), 0, 0});
+  timers_ns_.push(Timer{std::numeric_limits<unsigned long>::max(), 0, 0});
 }
 
 void TimerManager::AddTimer(const Timer& timer) {
   timers_.push(timer);
 }
 
+void TimerManager::AddTimerNs(const Timer& timer) {
+  timers_ns_.push(timer);
+  if (tsc_deadline_mode) {
+    ArmTSCDeadline();
+  }
+}
+
+void TimerManager::Notify(const Timer& t) {
+  Trace(TraceEvent::kTimerExpire, t.TaskID(), t.Value());
+  // 割り込みハンドラの中なので空きを待てない．タイムアウトは捨てずに後で送り直す
+  if (!NotifyTimeout(t)) {
+    undelivered_.push_back(t);
+  }
+}
+
+void TimerManager::RetryUndelivered() {
+  auto it = std::remove_if(undelivered_.begin(), undelivered_.end(), NotifyTimeout);
+  undelivered_.erase(it, undelivered_.end());
+}
+
 bool TimerManager::Tick() {
   ++tick_;
+  RetryUndelivered();
 
   bool task_timer_timeout = false;
   while (true) {
@@ -71,25 +228,60 @@ bool TimerManager::Tick() {
       continue;
     }
 
-    Message m{Message::kTimerTimeout};
-    m.arg.timer.timeout = t.Timeout();
-    m.arg.timer.value = t.Value();
-    task_manager->SendMessage(t.TaskID(), m);
-
+    Notify(t);
     timers_.pop();
   }
 
   return task_timer_timeout;
 }
 
+void TimerManager::ExpireTimersNs(uint64_t now_ns) {
+  while (true) {
+    const auto& t = timers_ns_.top();
+    if (t.Timeout() > now_ns) {
+      break;
+    }
+
+    // スケジューラとプロファイラが予約したタイマーは割り込みハンドラで処理する
+    if (t.Value() != kTaskTimerValue && t.Value() != kProfilerTimerValue) {
+      Notify(t);
+    }
+    timers_ns_.pop();
+  }
+}
+
 TimerManager* timer_manager;
 unsigned long lapic_timer_freq;
+unsigned long tsc_freq;
+bool tsc_invariant;
+TimePageFrame time_page_frame;
 
 extern "C" void LAPICTimerOnInterrupt(const TaskContext& ctx_stack) {
-  const bool task_timer_timeout = timer_manager->Tick();
+  ProfilerOnInterrupt(ctx_stack);
+
+  bool task_timer_timeout = false;
+  if (tsc_deadline_mode) {
+    // TSC-deadline モードは単発なので，tick を TSC から再現して次を予約し直す
+    const uint64_t now = ReadTSC();
+    while (next_tick_tsc <= now) {
+      task_timer_timeout |= timer_manager->Tick();
+      next_tick_tsc += tsc_per_tick;
+    }
+    timer_manager->ExpireTimersNs(TSCToNs(now));
+    ArmTSCDeadline();
+  } else {
+    task_timer_timeout = timer_manager->Tick();
+    timer_manager->ExpireTimersNs(CurrentTimeNs());
+  }
+  WriteTimePage([](TimePage& page) {
+    page.tick = timer_manager->CurrentTick();
+  });
   NotifyEndOfInterrupt();
 
-  if (task_timer_timeout) {
+  if (task_manager) {
+    task_manager->UpdateDeadlines();
+  }
+  if (task_timer_timeout || (task_manager && task_manager->NeedResched())) {
     task_manager->SwitchTask(ctx_stack);
   }
 }
@@ -5,12 +5,32 @@
 #include <vector>
 #include <limits>
 #include "message.hpp"
+#include "time_page.hpp"
 
 void InitializeLAPICTimer();
 void StartLAPICTimer();
 uint32_t LAPICTimerElapsed();
 void StopLAPICTimer();
 
+/** @brief 起動時からの経過時間をナノ秒単位で返す。
+ *
+ * 不変 TSC が使える場合は TSC を時計源とする。使えない場合の精度は 1 tick。
+ */
+uint64_t CurrentTimeNs();
+
+/** @brief 時刻ページの定数部分（TSC の較正値と UNIX 時刻との差）を設定する． */
+void InitializeTimePage();
+
+/** @brief アプリへ読み込み専用で割り当てる時刻ページのフレーム．
+ *
+ * 他のカーネルデータをアプリから読めないよう，4KiB ページ全体を占有する．
+ * 物理アドレスと仮想アドレスは等しい．
+ */
+struct alignas(4096) TimePageFrame {
+  TimePage page;
+};
+extern TimePageFrame time_page_frame;
+
 class Timer {
  public:
   Timer(unsigned long timeout, int value, uint64_t task_id);
@@ -33,17 +53,34 @@ class TimerManager {
  public:
   TimerManager();
   void AddTimer(const Timer& timer);
+  /** @brief タイムアウトを CurrentTimeNs() 基準のナノ秒で指定したタイマーを登録する。 */
+  void AddTimerNs(const Timer& timer);
   bool Tick();
+  /** @brief 期限が now_ns 以前のナノ秒タイマーを通知して取り除く。 */
+  void ExpireTimersNs(uint64_t now_ns);
+  /** @brief 最も早く期限を迎えるナノ秒タイマーのタイムアウト。 */
+  unsigned long NextTimeoutNs() const { return timers_ns_.top().Timeout(); }
   unsigned long CurrentTick() const { return tick_; }
 
  private:
   volatile unsigned long tick_{0};
   std::priority_queue<Timer> timers_{};
+  std::priority_queue<Timer> timers_ns_{};
+  // 送り先のキューが満杯で通知できなかったタイマー．次の tick で送り直す
+  std::vector<Timer> undelivered_{};
+
+  void Notify(const Timer& t);
+  void RetryUndelivered();
 };
 
 extern TimerManager* timer_manager;
 extern unsigned long lapic_timer_freq;
+/** @brief 起動時に計測した TSC の周波数 (Hz)。 */
+extern unsigned long tsc_freq;
+/** @brief TSC が不変（周波数が変わらない）で，時計源として使えるなら true。 */
+extern bool tsc_invariant;
 const int kTimerFreq = 100;
 
 const int kTaskTimerPeriod = static_cast<int>(kTimerFreq * 0.02);
 const int kTaskTimerValue = std::numeric_limits<int>::max();
+const int kProfilerTimerValue = std::numeric_limits<int>::max() - 1;
@@ -0,0 +1,63 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "asmfunc.h"
+#include "task.hpp"
+#include "timer.hpp"
+
+namespace {
+  // 要素数は 2 のべき乗にして，添え字の計算をマスクで済ませる
+  const size_t kNumRecords = 1 << 16;
+  std::array<TraceRecord, kNumRecords> records;
+  uint64_t next_index = 0;
+}
+
+bool trace_enabled = false;
+
+void TraceRecordEvent(TraceEvent event, uint64_t arg0, uint64_t arg1) {
+  // 割り込みハンドラからも呼ばれるので，書き込む場所の確保だけは不可分に行う
+  const uint64_t i = __atomic_fetch_add(&next_index, 1, __ATOMIC_RELAXED);
+  auto& r = records[i & (kNumRecords - 1)];
+  r.tsc = ReadTSC();
+  r.task_id = task_manager ? task_manager->CurrentTask().ID() : 0;
+  r.event = static_cast<uint16_t>(event);
+  r.reserved = 0;
+  r.arg0 = arg0;
+  r.arg1 = arg1;
+}
+
+void StartTrace() {
+  __asm__("cli");
+  next_index = 0;
+  trace_enabled = true;
+  __asm__("sti");
+}
+
+void StopTrace() {
+  __asm__("cli");
+  trace_enabled = false;
+  __asm__("sti");
+}
+
+size_t WriteTrace(FileDescriptor& fd) {
+  if (trace_enabled) {
+    return 0;
+  }
+
+  const size_t n = std::min<uint64_t>(next_index, kNumRecords);
+  TraceFileHeader header{};
+  memcpy(header.magic, "MKTRACE1", sizeof(header.magic));
+  header.tsc_freq = tsc_freq;
+  header.num_records = n;
+  header.dropped = next_index - n;
+  fd.Write(&header, sizeof(header));
+
+  // 一周していれば，次に上書きされる位置が最も古い記録
+  const size_t oldest = next_index > kNumRecords ? next_index & (kNumRecords - 1) : 0;
+  fd.Write(&records[oldest], sizeof(TraceRecord) * (n - oldest));
+  fd.Write(&records[0], sizeof(TraceRecord) * oldest);
+  return n;
+}
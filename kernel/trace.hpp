@@ -0,0 +1,64 @@
+/**
+ * @file trace.hpp
+ *
+ * カーネル内の出来事を TSC のタイムスタンプ付きで記録するトレース用リングバッファ．
+ *
+ * Log() と違って文字列を整形しないので，割り込みハンドラやスケジューラの中からでも
+ * 数 ns で記録できる．記録を止めているときは Trace() は分岐 1 つで終わる．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "file.hpp"
+
+/** @brief トレースポイントの種類．記録ファイルにもこの値がそのまま入る． */
+enum class TraceEvent : uint16_t {
+  kTaskSwitch = 1,     // arg0: 切り替え前のタスク ID, arg1: 切り替え後のタスク ID
+  kWakeup,             // arg0: 起床したタスク ID, arg1: レベル
+  kPageFaultEnter,     // arg0: 原因のアドレス, arg1: エラーコード
+  kPageFaultExit,      // arg0: 原因のアドレス, arg1: Error::Code
+  kSyscallEnter,       // arg0: システムコール番号
+  kSyscallExit,        // arg0: システムコール番号, arg1: エラー番号
+  kTimerExpire,        // arg0: 通知先のタスク ID, arg1: タイマーの値
+  kXHCIEvent,          // arg0: TRB の種類
+  kLayerDrawBegin,     // arg0: 合成する損傷領域の数
+  kLayerDrawEnd,       // arg0: 画面に転送したピクセル数
+};
+
+/** @brief リングバッファの 1 要素（32 バイト）． */
+struct TraceRecord {
+  uint64_t tsc;
+  uint32_t task_id;
+  uint16_t event;
+  uint16_t reserved;
+  uint64_t arg0, arg1;
+};
+
+/** @brief 記録ファイルの先頭に置くヘッダ．この後に古い順に TraceRecord が並ぶ． */
+struct TraceFileHeader {
+  char magic[8];      // "MKTRACE1"
+  uint64_t tsc_freq;  // tsc をマイクロ秒に換算するための周波数 (Hz)
+  uint64_t num_records;
+  uint64_t dropped;   // リングバッファが一周して上書きされた記録の数
+};
+
+extern bool trace_enabled;
+
+void TraceRecordEvent(TraceEvent event, uint64_t arg0, uint64_t arg1);
+
+/** @brief トレースポイント．記録中でなければ何もしない． */
+inline void Trace(TraceEvent event, uint64_t arg0 = 0, uint64_t arg1 = 0) {
+  if (__builtin_expect(trace_enabled, 0)) {
+    TraceRecordEvent(event, arg0, arg1);
+  }
+}
+
+/** @brief それまでの記録を捨てて記録を始める． */
+void StartTrace();
+/** @brief 記録を止める． */
+void StopTrace();
+/** @brief 記録を止めた状態で，記録をヘッダ付きで fd に書き出し，記録数を返す． */
+size_t WriteTrace(FileDescriptor& fd);
@@ -9,6 +9,7 @@
 #include "usb/device.hpp"
 #include "usb/descriptor.hpp"
 #include "usb/xhci/speed.hpp"
+#include "trace.hpp"
 
 namespace {
   using namespace usb::xhci;
@@ -546,6 +547,7 @@ namespace usb::xhci {
 
     Error err = MAKE_ERROR(Error::kNotImplemented);
     auto event_trb = xhc.PrimaryEventRing()->Front();
+    Trace(TraceEvent::kXHCIEvent, event_trb->bits.trb_type);
     if (auto trb = TRBDynamicCast<TransferEventTRB>(event_trb)) {
       err = OnEvent(xhc, *trb);
     } else if (auto trb = TRBDynamicCast<PortStatusChangeEventTRB>(event_trb)) {
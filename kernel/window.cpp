@@ -1,5 +1,6 @@
 #include "window.hpp"
 
+#include "blit.hpp"
 #include "logger.hpp"
 #include "font.hpp"
 
@@ -44,11 +45,6 @@ namespace {
 }
 
 Window::Window(int width, int height, PixelFormat shadow_format) : width_{width}, height_{height} {
-  data_.resize(height);
-  for (int y = 0; y < height; ++y) {
-    data_[y].resize(width);
-  }
-
   FrameBufferConfig config{};
   config.frame_buffer = nullptr;
   config.horizontal_resolution = width;
@@ -62,26 +58,47 @@ Window::Window(int width, int height, PixelFormat shadow_format) : width_{width}
 }
 
 void Window::DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& area) {
-  if (!transparent_color_) {
-    Rectangle<int> window_area{pos, Size()};
-    Rectangle<int> intersection = area & window_area;
+  Rectangle<int> window_area{pos, Size()};
+  Rectangle<int> intersection = area & window_area;
+  if (!transparent_color_ && row_alpha_.empty()) {
     dst.Copy(intersection.pos, shadow_buffer_, {intersection.pos - pos, intersection.size});
     return;
   }
 
-  const auto tc = transparent_color_.value();
-  auto& writer = dst.Writer();
-  for (int y = std::max(0, 0 - pos.y);
-       y < std::min(Height(), writer.Height() - pos.y);
-       ++y) {
-    for (int x = std::max(0, 0 - pos.x);
-         x < std::min(Width(), writer.Width() - pos.x);
-         ++x) {
-      const auto c = At(Vector2D<int>{x, y});
-      if (c != tc) {
-        writer.Write(pos + Vector2D<int>{x, y}, c);
+  // 描画対象範囲の中だけを 1 ピクセルずつ描く．透過色の比較も画面のピクセル形式で行う
+  const auto& dst_config = dst.Config();
+  if (dst_config.pixel_format != shadow_buffer_.Config().pixel_format) {
+    return;
+  }
+  const Rectangle<int> dst_area{
+    {0, 0}, {static_cast<int>(dst_config.horizontal_resolution),
+             static_cast<int>(dst_config.vertical_resolution)}};
+  intersection = intersection & dst_area;
+  const auto begin = intersection.pos - pos;
+
+  if (!row_alpha_.empty()) {
+    // 行ごとの分類で，不透明な行は複写，透明な行は省略し，残りだけを合成する
+    for (int y = 0; y < intersection.size.y; ++y) {
+      uint32_t* dst_row = dst.NativeAt(intersection.pos + Vector2D<int>{0, y});
+      const uint32_t* src_row = shadow_buffer_.NativeAt(begin + Vector2D<int>{0, y});
+      switch (GetRowAlpha(begin.y + y)) {
+      case RowAlpha::kOpaque:
+        CopyPixels(dst_row, src_row, intersection.size.x);
+        break;
+      case RowAlpha::kTransparent:
+        break;
+      default:
+        BlendPixels(dst_row, src_row, intersection.size.x);
       }
     }
+    return;
+  }
+
+  const uint32_t tc = shadow_buffer_.ToNative(transparent_color_.value());
+  for (int y = 0; y < intersection.size.y; ++y) {
+    CopyPixelsColorKey(dst.NativeAt(intersection.pos + Vector2D<int>{0, y}),
+                       shadow_buffer_.NativeAt(begin + Vector2D<int>{0, y}),
+                       intersection.size.x, tc);
   }
 }
 
@@ -89,17 +106,60 @@ void Window::SetTransparentColor(std::optional<PixelColor> c) {
   transparent_color_ = c;
 }
 
+void Window::SetAlphaBlending(bool enable) {
+  if (enable) {
+    row_alpha_.assign(height_, RowAlpha::kUnknown);
+  } else {
+    row_alpha_.clear();
+    row_alpha_.shrink_to_fit();
+  }
+}
+
+Window::RowAlpha Window::GetRowAlpha(int y) {
+  auto& state = row_alpha_[y];
+  if (state != RowAlpha::kUnknown) {
+    return state;
+  }
+
+  const uint32_t* row = shadow_buffer_.NativeAt({0, y});
+  uint32_t all_and = 0xffffffffu, all_or = 0;
+  for (int x = 0; x < width_; ++x) {
+    all_and &= row[x];
+    all_or |= row[x];
+  }
+  if ((all_and >> 24) == 0xff) {
+    state = RowAlpha::kOpaque;
+  } else if ((all_or >> 24) == 0) {
+    state = RowAlpha::kTransparent;
+  } else {
+    state = RowAlpha::kMixed;
+  }
+  return state;
+}
+
 Window::WindowWriter* Window::Writer() {
   return &writer_;
 }
 
-const PixelColor& Window::At(Vector2D<int> pos) const{
-  return data_[pos.y][pos.x];
+PixelColor Window::At(Vector2D<int> pos) const {
+  return shadow_buffer_.FromNative(*shadow_buffer_.NativeAt(pos));
 }
 
 void Window::Write(Vector2D<int> pos, PixelColor c) {
-  data_[pos.y][pos.x] = c;
-  shadow_buffer_.Writer().Write(pos, c);
+  // アプリが指定した座標がそのまま届くこともあるので，範囲外は捨てる
+  if (pos.x < 0 || pos.x >= width_ || pos.y < 0 || pos.y >= height_) {
+    return;
+  }
+  *shadow_buffer_.NativeAt(pos) = shadow_buffer_.ToNative(c);
+  InvalidateRowAlpha(pos.y);
+}
+
+void Window::WriteARGB(Vector2D<int> pos, uint32_t argb) {
+  const uint32_t a = argb >> 24;
+  auto premultiply = [a](uint32_t c) -> uint8_t { return (c & 0xff) * a / 255; };
+  const PixelColor c{premultiply(argb >> 16), premultiply(argb >> 8), premultiply(argb)};
+  *shadow_buffer_.NativeAt(pos) = (shadow_buffer_.ToNative(c) & 0x00ffffffu) | (a << 24);
+  InvalidateRowAlpha(pos.y);
 }
 
 int Window::Width() const {
@@ -116,6 +176,15 @@ Vector2D<int> Window::Size() const {
 
 void Window::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
   shadow_buffer_.Move(dst_pos, src);
+  for (int y = 0; y < src.size.y; ++y) {
+    InvalidateRowAlpha(dst_pos.y + y);
+  }
+}
+
+void Window::Commit(const Rectangle<int>& area) {
+  for (int y = 0; y < area.size.y; ++y) {
+    InvalidateRowAlpha(area.pos.y + y);
+  }
 }
 
 WindowRegion Window::GetWindowRegion(Vector2D<int> pos) {
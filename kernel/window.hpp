@@ -38,6 +38,27 @@ class Window {
     virtual int Width() const override { return window_.Width(); }
     /** @brief Height は関連付けられた Window の高さをピクセル単位で返す。 */
     virtual int Height() const override { return window_.Height(); }
+    /** @brief スパン操作は影バッファのピクセル形式に特化した Writer へそのまま渡す */
+    virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& c) override {
+      window_.shadow_buffer_.Writer().FillSpan(pos, len, c);
+      window_.InvalidateRowAlpha(pos.y);
+    }
+    virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len) override {
+      window_.shadow_buffer_.Writer().WriteSpan(pos, colors, len);
+      window_.InvalidateRowAlpha(pos.y);
+    }
+    virtual void WriteMaskedSpan(Vector2D<int> pos, const uint8_t* bits, int len,
+                                 const PixelColor& c) override {
+      window_.shadow_buffer_.Writer().WriteMaskedSpan(pos, bits, len, c);
+      window_.InvalidateRowAlpha(pos.y);
+    }
+    virtual void WriteGlyphs8(Vector2D<int> pos, const uint8_t* const* glyphs, int count,
+                              int rows, const PixelColor& c) override {
+      window_.shadow_buffer_.Writer().WriteGlyphs8(pos, glyphs, count, rows, c);
+      for (int dy = 0; dy < rows; ++dy) {
+        window_.InvalidateRowAlpha(pos.y + dy);
+      }
+    }
 
    private:
     Window& window_;
@@ -58,13 +79,23 @@ class Window {
   void DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& area);
   /** @brief 透過色を設定する。 */
   void SetTransparentColor(std::optional<PixelColor> c);
+  /** @brief ピクセルごとのアルファ値で下のレイヤーと合成するかを設定する。
+   *
+   * 有効にすると，各ピクセルの最上位バイトを乗算済みアルファ値として扱う。
+   * PixelColor で描いたピクセルは不透明になり，まだ何も描いていないピクセルは透明になる。
+   */
+  void SetAlphaBlending(bool enable);
+  /** @brief 透過するピクセルがなく，下のレイヤーを完全に隠すなら true を返す。 */
+  bool IsOpaque() const { return !transparent_color_ && row_alpha_.empty(); }
   /** @brief このインスタンスに紐付いた WindowWriter を取得する。 */
   WindowWriter* Writer();
 
   /** @brief 指定した位置のピクセルを返す。 */
-  const PixelColor& At(Vector2D<int> pos) const;
+  PixelColor At(Vector2D<int> pos) const;
   /** @brief 指定した位置にピクセルを書き込む。 */
   void Write(Vector2D<int> pos, PixelColor c);
+  /** @brief 指定した位置に 0xAARRGGBB 形式（乗算前）の半透明のピクセルを書き込む。 */
+  void WriteARGB(Vector2D<int> pos, uint32_t argb);
 
   /** @brief 平面描画領域の横幅をピクセル単位で返す。 */
   int Width() const;
@@ -81,16 +112,37 @@ class Window {
    */
   void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
 
+  /** @brief 影バッファを返す。アプリと共有するフレームの情報を得るのに使う。 */
+  const FrameBuffer& ShadowBuffer() const { return shadow_buffer_; }
+  /** @brief 影バッファを直接書き換えた範囲を知らせ，行ごとのアルファ値を調べ直させる。 */
+  void Commit(const Rectangle<int>& area);
+
   virtual void Activate() {}
   virtual void Deactivate() {}
   virtual WindowRegion GetWindowRegion(Vector2D<int> pos);
 
  private:
+  /** @brief 行ごとのアルファ値の分類．書き込まれた行は kUnknown に戻し，描画時に調べ直す */
+  enum class RowAlpha : uint8_t {
+    kUnknown,
+    kOpaque,       // すべて 0xff
+    kTransparent,  // すべて 0
+    kMixed,
+  };
+
+  void InvalidateRowAlpha(int y) {
+    if (!row_alpha_.empty() && 0 <= y && y < height_) {
+      row_alpha_[y] = RowAlpha::kUnknown;
+    }
+  }
+  RowAlpha GetRowAlpha(int y);
+
   int width_, height_;
-  std::vector<std::vector<PixelColor>> data_{};
   WindowWriter writer_{*this};
   std::optional<PixelColor> transparent_color_{std::nullopt};
+  std::vector<RowAlpha> row_alpha_{}; // アルファ合成が無効なら空
 
+  // ウィンドウの内容を画面と同じピクセル形式で保持する唯一のバッファ
   FrameBuffer shadow_buffer_{};
 };
 
@@ -111,6 +163,20 @@ class ToplevelWindow : public Window {
       return window_.Width() - kTopLeftMargin.x - kBottomRightMargin.x; }
     virtual int Height() const override {
       return window_.Height() - kTopLeftMargin.y - kBottomRightMargin.y; }
+    virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& c) override {
+      window_.Writer()->FillSpan(pos + kTopLeftMargin, len, c);
+    }
+    virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len) override {
+      window_.Writer()->WriteSpan(pos + kTopLeftMargin, colors, len);
+    }
+    virtual void WriteMaskedSpan(Vector2D<int> pos, const uint8_t* bits, int len,
+                                 const PixelColor& c) override {
+      window_.Writer()->WriteMaskedSpan(pos + kTopLeftMargin, bits, len, c);
+    }
+    virtual void WriteGlyphs8(Vector2D<int> pos, const uint8_t* const* glyphs, int count,
+                              int rows, const PixelColor& c) override {
+      window_.Writer()->WriteGlyphs8(pos + kTopLeftMargin, glyphs, count, rows, c);
+    }
 
    private:
     ToplevelWindow& window_;
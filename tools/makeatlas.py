@@ -0,0 +1,104 @@
+#!/usr/bin/python3
+
+"""
+JIS X 0208 の文字を 16 ピクセルの単色ビットマップに描き，カーネルに埋め込むアトラスを作る．
+
+形式（リトルエンディアン）:
+  ヘッダ   magic "MKATLAS1", uint32 グリフ数, uint8 グリフの高さ, uint8 1 行のバイト数, uint16 予約
+  索引     uint32 コードポイント × グリフ数（昇順）
+  グリフ   int8 left, int8 top, uint8 width, uint8 rows, ビットマップ（1 行 pitch バイト × 高さ）
+
+left, top は文字の描画位置から見たビットマップの左上で，カーネルの WriteUnicode と同じ計算で求める．
+グリフの大きさに収まらない文字は含めず，実行時に FreeType で描かせる．
+
+フォントの読み込みには freetype-py (pip install freetype-py) を使う．
+フォントファイルか freetype-py がなければ，グリフ数 0 のアトラス（ヘッダと空の索引）を書き出す．
+カーネルはその場合すべての文字を実行時に FreeType で描く．
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+try:
+    import freetype
+except ImportError:
+    freetype = None
+
+
+GLYPH_SIZE = 16
+PITCH = GLYPH_SIZE // 8
+
+HEADER = struct.Struct('<8sIBBH')
+GLYPH_HEADER = struct.Struct('<bbBB')
+
+
+def jis_x_0208_chars():
+    """JIS X 0208 の 1 区から 94 区までの文字を EUC-JP 経由で列挙する．"""
+    chars = set()
+    for row in range(0xa1, 0xff):
+        for cell in range(0xa1, 0xff):
+            try:
+                s = bytes([row, cell]).decode('euc_jp')
+            except UnicodeDecodeError:
+                continue
+            if len(s) == 1 and ord(s) > 0x7f:
+                chars.add(ord(s))
+    return sorted(chars)
+
+
+def render(face, code: int):
+    glyph_index = face.get_char_index(code)
+    if glyph_index == 0:
+        return None
+    face.load_glyph(glyph_index, freetype.FT_LOAD_RENDER | freetype.FT_LOAD_TARGET_MONO)
+    glyph = face.glyph
+    bitmap = glyph.bitmap
+    if bitmap.width > GLYPH_SIZE or bitmap.rows > GLYPH_SIZE:
+        return None
+
+    baseline = (face.height + face.descender) * face.size.y_ppem // face.units_per_EM
+    left = glyph.bitmap_left
+    top = baseline - glyph.bitmap_top
+    if not (-128 <= left < 128 and -128 <= top < 128):
+        return None
+
+    pitch = abs(bitmap.pitch)
+    row_bytes = (bitmap.width + 7) // 8
+    bits = bytearray(PITCH * GLYPH_SIZE)
+    for y in range(bitmap.rows):
+        src = bitmap.buffer[pitch * y:pitch * y + row_bytes]
+        bits[PITCH * y:PITCH * y + row_bytes] = bytes(src)
+    return GLYPH_HEADER.pack(left, top, bitmap.width, bitmap.rows) + bytes(bits)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('font', help='path to a TrueType/OpenType font file')
+    parser.add_argument('-o', help='path to an output file', default='atlas.bin')
+    ns = parser.parse_args()
+
+    codes = []
+    glyphs = []
+    if freetype is None:
+        print('makeatlas: freetype-py not found, writing an empty atlas', file=sys.stderr)
+    elif not os.path.isfile(ns.font):
+        print(f'makeatlas: {ns.font} not found, writing an empty atlas', file=sys.stderr)
+    else:
+        face = freetype.Face(ns.font)
+        face.set_pixel_sizes(GLYPH_SIZE, GLYPH_SIZE)
+        for code in jis_x_0208_chars():
+            glyph = render(face, code)
+            if glyph is not None:
+                codes.append(code)
+                glyphs.append(glyph)
+
+    with open(ns.o, 'wb') as out:
+        out.write(HEADER.pack(b'MKATLAS1', len(codes), GLYPH_SIZE, PITCH, 0))
+        out.write(struct.pack(f'<{len(codes)}I', *codes))
+        out.write(b''.join(glyphs))
+
+
+if __name__ == '__main__':
+    main()
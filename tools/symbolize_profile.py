@@ -0,0 +1,87 @@
+#!/usr/bin/python3
+
+"""
+`profile stop <file>` で書き出したサンプルのアドレスを関数名に変換する．
+
+出力は flamegraph.pl などが読める folded stacks 形式．
+"""
+
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+
+class SymbolTable:
+    def __init__(self, elf_path: str, nm: str):
+        out = subprocess.run([nm, '-n', '-C', '--defined-only', elf_path],
+                             check=True, capture_output=True, text=True).stdout
+        self.addrs = []
+        self.names = []
+        for line in out.splitlines():
+            parts = line.split(' ', 2)
+            if len(parts) < 3 or parts[1] not in 'tTwW':
+                continue
+            self.addrs.append(int(parts[0], 16))
+            self.names.append(parts[2])
+
+    def lookup(self, addr: int) -> str:
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i < 0:
+            return hex(addr)
+        return self.names[i]
+
+
+def symbolize(line: str, kernel, apps, default_app) -> str:
+    stack, count = line.rsplit(' ', 1)
+    task_id, cpl, *pcs = stack.split(';')
+    table = kernel if cpl == '0' else apps.get(task_id, default_app)
+
+    frames = []
+    for i, pc in enumerate(pcs):
+        addr = int(pc, 16)
+        # 最後の要素（割り込まれた RIP）以外は戻り先なので，呼び出し命令の中を指すようにする
+        if i != len(pcs) - 1:
+            addr -= 1
+        frames.append(table.lookup(addr) if table else hex(addr))
+
+    mode = 'kernel' if cpl == '0' else 'user'
+    return ';'.join([f'task{task_id}', mode] + frames) + ' ' + count
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('profile', help='path to a file written by "profile stop"')
+    parser.add_argument('--kernel', help='path to kernel.elf', default='kernel/kernel.elf')
+    parser.add_argument('--app', help='app ELF used for user-mode samples')
+    parser.add_argument('--task-app', action='append', default=[],
+                        metavar='ID=ELF', help='app ELF for a specific task ID')
+    parser.add_argument('--nm', help='nm command', default='nm')
+    parser.add_argument('-o', help='path to an output file')
+    ns = parser.parse_args()
+
+    kernel = SymbolTable(ns.kernel, ns.nm)
+    default_app = SymbolTable(ns.app, ns.nm) if ns.app else None
+    apps = {}
+    for spec in ns.task_app:
+        task_id, path = spec.split('=', 1)
+        apps[task_id] = SymbolTable(path, ns.nm)
+
+    # 異なるアドレスが同じ関数になる場合があるので，変換後に集計し直す
+    counts = collections.Counter()
+    with open(ns.profile) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            stack, count = symbolize(line, kernel, apps, default_app).rsplit(' ', 1)
+            counts[stack] += int(count)
+
+    out = open(ns.o, 'w') if ns.o else sys.stdout
+    for stack, count in counts.items():
+        print(f'{stack} {count}', file=out)
+
+
+if __name__ == '__main__':
+    main()
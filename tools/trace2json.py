@@ -0,0 +1,117 @@
+#!/usr/bin/python3
+
+"""
+`trace dump <file>` で書き出したトレースを Chrome の trace event 形式 (JSON) に変換する．
+
+出力は chrome://tracing や Perfetto で開ける．
+"""
+
+import argparse
+import json
+import struct
+
+
+HEADER = struct.Struct('<8sQQQ')
+RECORD = struct.Struct('<QIHHQQ')
+
+TASK_SWITCH = 1
+WAKEUP = 2
+PAGE_FAULT_ENTER = 3
+PAGE_FAULT_EXIT = 4
+SYSCALL_ENTER = 5
+SYSCALL_EXIT = 6
+TIMER_EXPIRE = 7
+XHCI_EVENT = 8
+LAYER_DRAW_BEGIN = 9
+LAYER_DRAW_END = 10
+
+CPU_TID = 0  # タスクの切り替えを並べるスレッド
+
+
+def convert(data: bytes) -> list:
+    magic, tsc_freq, num_records, dropped = HEADER.unpack_from(data, 0)
+    if magic != b'MKTRACE1':
+        raise ValueError('not a trace file')
+
+    records = [RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+               for i in range(num_records)]
+    if not records:
+        return []
+    base = records[0][0]
+
+    def ts(tsc):
+        return (tsc - base) * 1e6 / tsc_freq
+
+    events = [{'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': CPU_TID,
+               'args': {'name': 'CPU'}}]
+    if dropped:
+        events.append({'name': f'{dropped} records dropped', 'ph': 'i',
+                       'pid': 0, 'tid': CPU_TID, 'ts': 0, 's': 'g'})
+
+    task_ids = set()
+    running = None
+    for tsc, task_id, event, _, arg0, arg1 in records:
+        t = ts(tsc)
+        task_ids.add(task_id)
+        common = {'pid': 0, 'tid': task_id, 'ts': t}
+
+        if event == TASK_SWITCH:
+            if running is not None:
+                events.append({'name': f'task {running}', 'ph': 'E',
+                               'pid': 0, 'tid': CPU_TID, 'ts': t})
+            running = arg1
+            events.append({'name': f'task {running}', 'ph': 'B',
+                           'pid': 0, 'tid': CPU_TID, 'ts': t,
+                           'args': {'from': arg0}})
+        elif event == WAKEUP:
+            events.append({'name': 'wakeup', 'ph': 'i', 's': 't',
+                           'args': {'task': arg0, 'level': arg1}, **common})
+        elif event == PAGE_FAULT_ENTER:
+            events.append({'name': 'page fault', 'ph': 'B',
+                           'args': {'addr': hex(arg0), 'error_code': arg1},
+                           **common})
+        elif event == PAGE_FAULT_EXIT:
+            events.append({'name': 'page fault', 'ph': 'E',
+                           'args': {'result': arg1}, **common})
+        elif event == SYSCALL_ENTER:
+            events.append({'name': f'syscall {arg0:#x}', 'ph': 'B', **common})
+        elif event == SYSCALL_EXIT:
+            events.append({'name': f'syscall {arg0:#x}', 'ph': 'E',
+                           'args': {'errno': arg1}, **common})
+        elif event == TIMER_EXPIRE:
+            events.append({'name': 'timer', 'ph': 'i', 's': 't',
+                           'args': {'task': arg0, 'value': arg1}, **common})
+        elif event == XHCI_EVENT:
+            events.append({'name': 'xhci event', 'ph': 'i', 's': 't',
+                           'args': {'trb_type': arg0}, **common})
+        elif event == LAYER_DRAW_BEGIN:
+            events.append({'name': 'composite', 'ph': 'B',
+                           'args': {'rects': arg0}, **common})
+        elif event == LAYER_DRAW_END:
+            events.append({'name': 'composite', 'ph': 'E',
+                           'args': {'pixels': arg0}, **common})
+
+    if running is not None:
+        events.append({'name': f'task {running}', 'ph': 'E',
+                       'pid': 0, 'tid': CPU_TID, 'ts': ts(records[-1][0])})
+
+    for task_id in sorted(task_ids):
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': 0,
+                       'tid': task_id, 'args': {'name': f'task {task_id}'}})
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('trace', help='path to a file written by "trace dump"')
+    parser.add_argument('-o', help='path to an output file', default='trace.json')
+    ns = parser.parse_args()
+
+    with open(ns.trace, 'rb') as f:
+        events = convert(f.read())
+    with open(ns.o, 'w') as out:
+        json.dump({'traceEvents': events, 'displayTimeUnit': 'ns'}, out)
+
+
+if __name__ == '__main__':
+    main()